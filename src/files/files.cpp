@@ -21,3 +21,25 @@ bool read_binary_file(std::string filename, char* data, size_t size) {
 	output.close();
 	return true;
 }
+
+char* read_binary_file(std::string filename, size_t& length) {
+	std::ifstream input(filename, std::ios::binary);
+	if (!input.is_open())
+		return nullptr;
+	input.seekg(0, std::ios::end);
+	std::streamoff end = input.tellg();
+	// size unknown, e.g. for a pipe
+	if (end < 0)
+		return nullptr;
+	length = end;
+	input.seekg(0, std::ios::beg);
+
+	char* data = new char[length];
+	input.read(data, length);
+	if (!input){
+		delete[] data;
+		return nullptr;
+	}
+	input.close();
+	return data;
+}
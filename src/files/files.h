@@ -5,5 +5,6 @@
 
 extern bool write_binary_file(std::string filename, const char* data, size_t size);
 extern bool read_binary_file(std::string filename, char* data, size_t size);
+extern char* read_binary_file(std::string filename, size_t& length);
 
 #endif /* FILES_FILES_H_ */
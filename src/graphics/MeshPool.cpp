@@ -0,0 +1,25 @@
+#include "MeshPool.h"
+#include "Mesh.h"
+
+std::vector<Mesh*> MeshPool::meshes;
+
+Mesh* MeshPool::acquire(const float* buffer, size_t vertices, const int* attrs){
+	if (meshes.empty())
+		return new Mesh(buffer, vertices, attrs);
+	Mesh* mesh = meshes.back();
+	meshes.pop_back();
+	mesh->reload(buffer, vertices);
+	return mesh;
+}
+
+void MeshPool::release(Mesh* mesh){
+	if (mesh != nullptr)
+		meshes.push_back(mesh);
+}
+
+void MeshPool::finalize(){
+	for (Mesh* mesh : meshes){
+		delete mesh;
+	}
+	meshes.clear();
+}
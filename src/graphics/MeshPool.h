@@ -0,0 +1,19 @@
+#ifndef GRAPHICS_MESHPOOL_H_
+#define GRAPHICS_MESHPOOL_H_
+
+#include <stdlib.h>
+#include <vector>
+
+class Mesh;
+
+// Released chunk meshes kept to reuse their vertex array and buffer.
+// All meshes in the pool must share one vertex format.
+class MeshPool {
+	static std::vector<Mesh*> meshes;
+public:
+	static Mesh* acquire(const float* buffer, size_t vertices, const int* attrs);
+	static void release(Mesh* mesh);
+	static void finalize();
+};
+
+#endif /* GRAPHICS_MESHPOOL_H_ */
@@ -1,7 +1,10 @@
 #include "VoxelRenderer.h"
 #include "Mesh.h"
+#include "MeshPool.h"
 #include "../voxels/Chunk.h"
 #include "../voxels/voxel.h"
+#include "../voxels/VoxelPalette.h"
+#include "../voxels/VoxelMasks.h"
 #include "../voxels/Block.h"
 #include "../lighting/Lightmap.h"
 
@@ -14,8 +17,10 @@
 #define GET_CHUNK(X,Y,Z) (chunks[((CDIV(Y, CHUNK_H)+1) * 3 + CDIV(Z, CHUNK_D) + 1) * 3 + CDIV(X, CHUNK_W) + 1])
 
 #define LIGHT(X,Y,Z, CHANNEL) (IS_CHUNK(X,Y,Z) ? GET_CHUNK(X,Y,Z)->lightmap->get(LOCAL(X, CHUNK_W), LOCAL(Y, CHUNK_H), LOCAL(Z, CHUNK_D), (CHANNEL)) : 0)
-#define VOXEL(X,Y,Z) (GET_CHUNK(X,Y,Z)->voxels[(LOCAL(Y, CHUNK_H) * CHUNK_D + LOCAL(Z, CHUNK_D)) * CHUNK_W + LOCAL(X, CHUNK_W)])
-#define IS_BLOCKED(X,Y,Z,GROUP) ((!IS_CHUNK(X, Y, Z)) || Block::blocks[VOXEL(X, Y, Z).id]->drawGroup == (GROUP))
+#define VOXEL(X,Y,Z) (GET_CHUNK(X,Y,Z)->voxels->get((LOCAL(Y, CHUNK_H) * CHUNK_D + LOCAL(Z, CHUNK_D)) * CHUNK_W + LOCAL(X, CHUNK_W)))
+// opaque mask row of the chunk holding (X,Y,Z), missing chunks block everything
+#define OPAQUE_ROW(X,Y,Z) (IS_CHUNK(X,Y,Z) ? GET_CHUNK(X,Y,Z)->masks->opaque[LOCAL(Y, CHUNK_H) * CHUNK_D + LOCAL(Z, CHUNK_D)] : (maskrow)~0)
+#define IS_BLOCKED(X,Y,Z,GROUP) ((!IS_CHUNK(X, Y, Z)) || Block::drawGroupTable[VOXEL(X, Y, Z).id] == (GROUP))
 
 #define VERTEX(INDEX, X,Y,Z, U,V, R,G,B,S) buffer[INDEX+0] = (X);\
 								  buffer[INDEX+1] = (Y);\
@@ -46,10 +51,27 @@ VoxelRenderer::~VoxelRenderer(){
 
 Mesh* VoxelRenderer::render(Chunk* chunk, const Chunk** chunks){
 	size_t index = 0;
+	if (chunk->voxels->isUniform() && !chunk->voxels->get(0).id){
+		return build(chunk, 0);
+	}
 	for (int y = 0; y < CHUNK_H; y++){
 		for (int z = 0; z < CHUNK_D; z++){
+			// opaque voxels with six opaque neighbours have no visible faces
+			const maskrow row = OPAQUE_ROW(0,y,z);
+			const maskrow left = (maskrow)(row << 1) | (OPAQUE_ROW(-1,y,z) >> (CHUNK_W-1));
+			const maskrow right = (row >> 1) | (maskrow)(OPAQUE_ROW(CHUNK_W,y,z) << (CHUNK_W-1));
+			const maskrow hidden = row & left & right &
+					OPAQUE_ROW(0,y-1,z) & OPAQUE_ROW(0,y+1,z) &
+					OPAQUE_ROW(0,y,z-1) & OPAQUE_ROW(0,y,z+1);
+			const maskrow visible = chunk->masks->solid[y * CHUNK_D + z] & ~hidden;
+			if (!visible){
+				continue;
+			}
 			for (int x = 0; x < CHUNK_W; x++){
-				voxel vox = chunk->voxels[(y * CHUNK_D + z) * CHUNK_W + x];
+				if (!((visible >> x) & 1)){
+					continue;
+				}
+				voxel vox = chunk->voxels->get((y * CHUNK_D + z) * CHUNK_W + x);
 				unsigned int id = vox.id;
 
 				if (!id){
@@ -59,13 +81,13 @@ Mesh* VoxelRenderer::render(Chunk* chunk, const Chunk** chunks){
 				float l;
 				float uvsize = 1.0f/16.0f;
 
-				Block* block = Block::blocks[id];
-				unsigned char group = block->drawGroup;
+				const int* faces = Block::textureFacesTable[id];
+				unsigned char group = Block::drawGroupTable[id];
 
 				if (!IS_BLOCKED(x,y+1,z,group)){
 					l = 1.0f;
 
-					SETUP_UV(block->textureFaces[3]);
+					SETUP_UV(faces[3]);
 
 					float lr = LIGHT(x,y+1,z, 0) / 15.0f;
 					float lg = LIGHT(x,y+1,z, 1) / 15.0f;
@@ -103,7 +125,7 @@ Mesh* VoxelRenderer::render(Chunk* chunk, const Chunk** chunks){
 				if (!IS_BLOCKED(x,y-1,z,group)){
 					l = 0.75f;
 
-					SETUP_UV(block->textureFaces[2]);
+					SETUP_UV(faces[2]);
 
 					float lr = LIGHT(x,y-1,z, 0) / 15.0f;
 					float lg = LIGHT(x,y-1,z, 1) / 15.0f;
@@ -142,7 +164,7 @@ Mesh* VoxelRenderer::render(Chunk* chunk, const Chunk** chunks){
 				if (!IS_BLOCKED(x+1,y,z,group)){
 					l = 0.95f;
 
-					SETUP_UV(block->textureFaces[1]);
+					SETUP_UV(faces[1]);
 
 					float lr = LIGHT(x+1,y,z, 0) / 15.0f;
 					float lg = LIGHT(x+1,y,z, 1) / 15.0f;
@@ -180,7 +202,7 @@ Mesh* VoxelRenderer::render(Chunk* chunk, const Chunk** chunks){
 				if (!IS_BLOCKED(x-1,y,z,group)){
 					l = 0.85f;
 
-					SETUP_UV(block->textureFaces[0]);
+					SETUP_UV(faces[0]);
 
 					float lr = LIGHT(x-1,y,z, 0) / 15.0f;
 					float lg = LIGHT(x-1,y,z, 1) / 15.0f;
@@ -219,7 +241,7 @@ Mesh* VoxelRenderer::render(Chunk* chunk, const Chunk** chunks){
 				if (!IS_BLOCKED(x,y,z+1,group)){
 					l = 0.9f;
 
-					SETUP_UV(block->textureFaces[5]);
+					SETUP_UV(faces[5]);
 
 					float lr = LIGHT(x,y,z+1, 0) / 15.0f;
 					float lg = LIGHT(x,y,z+1, 1) / 15.0f;
@@ -257,7 +279,7 @@ Mesh* VoxelRenderer::render(Chunk* chunk, const Chunk** chunks){
 				if (!IS_BLOCKED(x,y,z-1,group)){
 					l = 0.8f;
 
-					SETUP_UV(block->textureFaces[4]);
+					SETUP_UV(faces[4]);
 
 					float lr = LIGHT(x,y,z-1, 0) / 15.0f;
 					float lg = LIGHT(x,y,z-1, 1) / 15.0f;
@@ -295,5 +317,13 @@ Mesh* VoxelRenderer::render(Chunk* chunk, const Chunk** chunks){
 			}
 		}
 	}
-	return new Mesh(buffer, index / VERTEX_SIZE, chunk_attrs);
+	return build(chunk, index / VERTEX_SIZE);
+}
+
+Mesh* VoxelRenderer::build(Chunk* chunk, size_t vertices){
+	if (chunk->mesh != nullptr){
+		chunk->mesh->reload(buffer, vertices);
+		return chunk->mesh;
+	}
+	return MeshPool::acquire(buffer, vertices, chunk_attrs);
 }
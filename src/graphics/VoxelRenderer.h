@@ -9,10 +9,13 @@ class Chunk;
 class VoxelRenderer {
 	float* buffer;
 	size_t capacity;
+
+	Mesh* build(Chunk* chunk, size_t vertices);
 public:
 	VoxelRenderer(size_t capacity);
 	~VoxelRenderer();
 
+	// reloads the chunk mesh if there is one
 	Mesh* render(Chunk* chunk, const Chunk** chunks);
 };
 
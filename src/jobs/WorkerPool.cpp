@@ -0,0 +1,101 @@
+#include "WorkerPool.h"
+
+#include <atomic>
+
+WorkerPool::WorkerPool(unsigned int threads) : stopping(false){
+	if (threads == 0)
+		threads = std::thread::hardware_concurrency();
+	if (threads == 0)
+		threads = 1;
+	for (unsigned int i = 0; i < threads; i++){
+		this->threads.push_back(std::thread(&WorkerPool::work, this));
+	}
+}
+
+WorkerPool::~WorkerPool(){
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	condition.notify_all();
+	for (std::thread& thread : threads){
+		thread.join();
+	}
+}
+
+void WorkerPool::work(){
+	while (true){
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			condition.wait(lock, [this]{return stopping || !jobs.empty();});
+			if (jobs.empty())
+				return;
+			job = std::move(jobs.front());
+			jobs.pop();
+		}
+		job();
+	}
+}
+
+void WorkerPool::submit(std::function<void()> job){
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		jobs.push(std::move(job));
+	}
+	condition.notify_one();
+}
+
+void WorkerPool::parallelFor(size_t count, const std::function<void(size_t)>& job){
+	if (count == 0)
+		return;
+	std::atomic<size_t> next(0);
+	auto run = [&](){
+		for (size_t i = next++; i < count; i = next++){
+			job(i);
+		}
+	};
+
+	size_t helpers = threads.size();
+	if (helpers > count - 1)
+		helpers = count - 1;
+
+	// helpers refer to this frame, so all of them must finish before returning
+	std::mutex doneMutex;
+	std::condition_variable doneCondition;
+	size_t running = helpers;
+	for (size_t i = 0; i < helpers; i++){
+		submit([&](){
+			run();
+			std::lock_guard<std::mutex> lock(doneMutex);
+			if (--running == 0)
+				doneCondition.notify_all();
+		});
+	}
+	run();
+
+	// queued jobs are run while waiting, so that jobs may call parallelFor
+	// themselves without every thread ending up waiting
+	while (true){
+		{
+			std::lock_guard<std::mutex> lock(doneMutex);
+			if (running == 0)
+				break;
+		}
+		std::function<void()> queued;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!jobs.empty()){
+				queued = std::move(jobs.front());
+				jobs.pop();
+			}
+		}
+		if (queued){
+			queued();
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(doneMutex);
+		doneCondition.wait(lock, [&]{return running == 0;});
+		break;
+	}
+}
@@ -0,0 +1,34 @@
+#ifndef JOBS_WORKERPOOL_H_
+#define JOBS_WORKERPOOL_H_
+
+#include <stdlib.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <queue>
+#include <vector>
+
+class WorkerPool {
+	std::vector<std::thread> threads;
+	std::queue<std::function<void()>> jobs;
+	std::mutex mutex;
+	std::condition_variable condition;
+	bool stopping;
+
+	void work();
+public:
+	// 0 threads means one per hardware thread
+	WorkerPool(unsigned int threads);
+	~WorkerPool();
+
+	void submit(std::function<void()> job);
+
+	// calls job(0) ... job(count-1) on the workers and the calling thread,
+	// returns when all calls are finished; may be called from jobs
+	void parallelFor(size_t count, const std::function<void(size_t)>& job);
+
+	unsigned int size() const {return threads.size();}
+};
+
+#endif /* JOBS_WORKERPOOL_H_ */
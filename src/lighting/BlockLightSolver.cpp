@@ -0,0 +1,226 @@
+#include "BlockLightSolver.h"
+#include "Lightmap.h"
+#include "../voxels/Chunks.h"
+#include "../voxels/Chunk.h"
+#include "../voxels/voxel.h"
+#include "../voxels/VoxelPalette.h"
+#include "../voxels/Block.h"
+
+// Light is handled as three 8-bit lanes (r | g << 8 | b << 16) holding
+// 0..15 each, so lanes can be compared and decremented with plain integer
+// arithmetic without borrows crossing into the next lane. Entries keep
+// light packed, lanes are unpacked when they are solved.
+#define LANES_LOW 0x010101u
+#define LANES_HIGH 0x808080u
+#define LANES_ALL 0xFFFFFFu
+
+static inline uint32_t unpack(unsigned short light){
+	return (light & 0xF) | ((light & 0xF0) << 4) | ((light & 0xF00) << 8);
+}
+
+static inline unsigned short pack(uint32_t lanes){
+	return (lanes & 0xF) | ((lanes >> 4) & 0xF0) | ((lanes >> 8) & 0xF00);
+}
+
+// 0xFF in lanes where a >= b
+static inline uint32_t greaterEqual(uint32_t a, uint32_t b){
+	return ((((a | LANES_HIGH) - b) >> 7) & LANES_LOW) * 0xFF;
+}
+
+// 0xFF in lanes that are not zero
+static inline uint32_t nonZero(uint32_t a){
+	return (((a + 0x7F7F7Fu) >> 7) & LANES_LOW) * 0xFF;
+}
+
+static inline uint32_t decrement(uint32_t a){
+	return a - (nonZero(a) & LANES_LOW);
+}
+
+BlockLightSolver::BlockLightSolver(Chunks* chunks)
+		: LightSolverBase(chunks) {
+}
+
+void BlockLightSolver::add(Chunk* chunk, int lx, int ly, int lz, unsigned short emission) {
+	// channels of 0 or 1 do not spread and are not written
+	uint32_t light = unpack(emission);
+	light &= greaterEqual(light, 2 * LANES_LOW);
+	if (!light)
+		return;
+	const uint32_t lanes = nonZero(light);
+	const uint32_t current = unpack(chunk->lightmap->getRGB(lx, ly, lz));
+
+	addqueue.push(makeEntry(chunk, lx, ly, lz, pack(light)));
+
+	touch(chunk);
+	chunk->lightmap->setRGB(lx, ly, lz, pack((current & ~lanes) | light));
+}
+
+void BlockLightSolver::add(int x, int y, int z, unsigned short emission) {
+	Chunk* chunk = chunks->getChunkByVoxel(x, y, z);
+	if (chunk == nullptr)
+		return;
+	add(chunk, x-chunk->x*CHUNK_W, y-chunk->y*CHUNK_H, z-chunk->z*CHUNK_D, emission);
+}
+
+void BlockLightSolver::add(int x, int y, int z) {
+	Chunk* chunk = chunks->getChunkByVoxel(x, y, z);
+	if (chunk == nullptr)
+		return;
+	const int lx = x-chunk->x*CHUNK_W;
+	const int ly = y-chunk->y*CHUNK_H;
+	const int lz = z-chunk->z*CHUNK_D;
+	add(chunk, lx, ly, lz, chunk->lightmap->getRGB(lx, ly, lz));
+}
+
+void BlockLightSolver::remove(int x, int y, int z) {
+	Chunk* chunk = chunks->getChunkByVoxel(x, y, z);
+	if (chunk == nullptr)
+		return;
+
+	const int lx = x-chunk->x*CHUNK_W;
+	const int ly = y-chunk->y*CHUNK_H;
+	const int lz = z-chunk->z*CHUNK_D;
+	uint32_t light = unpack(chunk->lightmap->getRGB(lx, ly, lz));
+	if (light == 0){
+		return;
+	}
+
+	remqueue.push(makeEntry(chunk, lx, ly, lz, pack(light)));
+
+	chunk->lightmap->setRGB(lx, ly, lz, 0);
+}
+
+inline void BlockLightSolver::removeNext(){
+	const rgbentry current = remqueue.front();
+	remqueue.pop();
+	Chunk* const source = chunks->slots[current.slot];
+	int ex, ey, ez;
+	unindex(current.index, ex, ey, ez);
+
+	const uint32_t lanes = unpack(current.light);
+	const uint32_t removing = nonZero(lanes);
+	const uint32_t lower = decrement(lanes);
+
+	for (size_t i = 0; i < 6; i++) {
+		int x = ex+coords[i*3+0];
+		int y = ey+coords[i*3+1];
+		int z = ez+coords[i*3+2];
+		Chunk* chunk = source->locate(x,y,z);
+		if (chunk) {
+			const uint32_t light = unpack(chunk->lightmap->getRGB(x, y, z));
+			// lit by the removed light: one less than it
+			const uint32_t removed = removing & nonZero(light) &
+					greaterEqual(light, lower) & greaterEqual(lower, light);
+			// lit by something else: spreads again
+			const uint32_t kept = removing & ~removed & greaterEqual(light, lanes);
+			if (removed){
+				remqueue.push(makeEntry(chunk, x, y, z, pack(light & removed)));
+				chunk->lightmap->setRGB(x, y, z, pack(light & ~removed));
+				touch(chunk);
+			}
+			if (kept){
+				addqueue.push(makeEntry(chunk, x, y, z, pack(light & kept)));
+			}
+		}
+	}
+}
+
+inline void BlockLightSolver::addNext(){
+	const rgbentry current = addqueue.front();
+	addqueue.pop();
+	Chunk* const source = chunks->slots[current.slot];
+	int ex, ey, ez;
+	unindex(current.index, ex, ey, ez);
+
+	// channels removed after they were queued or too dark to spread
+	const uint32_t lanes = unpack(current.light);
+	const uint32_t present = unpack(source->lightmap->getRGB(ex, ey, ez));
+	uint32_t light = lanes & greaterEqual(present, lanes) & greaterEqual(lanes, present);
+	light &= greaterEqual(light, 2 * LANES_LOW);
+	if (!light)
+		return;
+	const uint32_t lower = decrement(light);
+
+	for (size_t i = 0; i < 6; i++) {
+		int x = ex+coords[i*3+0];
+		int y = ey+coords[i*3+1];
+		int z = ez+coords[i*3+2];
+		Chunk* chunk = source->locate(x,y,z);
+		if (chunk) {
+			voxel v = chunk->voxels->get((y * CHUNK_D + z) * CHUNK_W + x);
+			if (!Block::lightPassingTable[v.id])
+				continue;
+			const uint32_t neighbour = unpack(chunk->lightmap->getRGB(x, y, z));
+			const uint32_t brighter = ~greaterEqual(neighbour, lower) & LANES_ALL;
+			if (brighter){
+				chunk->lightmap->setRGB(x, y, z, pack((neighbour & ~brighter) | (lower & brighter)));
+				touch(chunk);
+				addqueue.push(makeEntry(chunk, x, y, z, pack(lower & brighter)));
+			}
+		}
+	}
+}
+
+// the add loop of solve for the voxels of one chunk, see LightSolver::drain
+void BlockLightSolver::drain(LightPartition<rgbentry>& partition){
+	Chunk* const chunk = partition.chunk;
+	Lightmap* const lightmap = chunk->lightmap;
+	std::vector<rgbentry>& queue = partition.queue;
+	queue.swap(partition.seeds);
+	for (const rgbentry& current : partition.inbox){
+		int ex, ey, ez;
+		unindex(current.index, ex, ey, ez);
+		voxel v = chunk->voxels->get(current.index);
+		if (!Block::lightPassingTable[v.id])
+			continue;
+		const uint32_t lanes = unpack(current.light);
+		const uint32_t present = unpack(lightmap->getRGB(ex, ey, ez));
+		const uint32_t brighter = ~greaterEqual(present, lanes) & LANES_ALL;
+		if (brighter){
+			lightmap->setRGB(ex, ey, ez, pack((present & ~brighter) | (lanes & brighter)));
+			partition.modified = true;
+			queue.push_back(makeEntry(chunk, ex, ey, ez, pack(lanes & brighter)));
+		}
+	}
+	partition.inbox.clear();
+
+	for (size_t head = 0; head < queue.size(); head++){
+		const rgbentry current = queue[head];
+		int ex, ey, ez;
+		unindex(current.index, ex, ey, ez);
+		const uint32_t lanes = unpack(current.light);
+		const uint32_t present = unpack(lightmap->getRGB(ex, ey, ez));
+		uint32_t light = lanes & greaterEqual(present, lanes) & greaterEqual(lanes, present);
+		light &= greaterEqual(light, 2 * LANES_LOW);
+		if (!light)
+			continue;
+		const uint32_t lower = decrement(light);
+
+		for (size_t i = 0; i < 6; i++) {
+			int x = ex+coords[i*3+0];
+			int y = ey+coords[i*3+1];
+			int z = ez+coords[i*3+2];
+			Chunk* other = chunk->locate(x,y,z);
+			if (other == nullptr)
+				continue;
+			voxel v = other->voxels->get((y * CHUNK_D + z) * CHUNK_W + x);
+			if (!Block::lightPassingTable[v.id])
+				continue;
+			// stale lanes of other chunks can only be darker
+			const uint32_t neighbour = unpack(other->lightmap->getRGB(x, y, z));
+			const uint32_t brighter = ~greaterEqual(neighbour, lower) & LANES_ALL;
+			if (!brighter)
+				continue;
+			if (other != chunk){
+				partition.outbox.push_back(makeEntry(other, x, y, z, pack(lower & brighter)));
+				continue;
+			}
+			lightmap->setRGB(x, y, z, pack((neighbour & ~brighter) | (lower & brighter)));
+			partition.modified = true;
+			queue.push_back(makeEntry(chunk, x, y, z, pack(lower & brighter)));
+		}
+	}
+	queue.clear();
+}
+
+template class LightSolverBase<BlockLightSolver, rgbentry>;
@@ -0,0 +1,43 @@
+#ifndef LIGHTING_BLOCKLIGHTSOLVER_H_
+#define LIGHTING_BLOCKLIGHTSOLVER_H_
+
+#include <vector>
+#include <stdint.h>
+#include "LightSolverBase.h"
+
+class Chunks;
+class Chunk;
+
+struct rgbentry {
+	// chunk and voxel, as in lightentry
+	uint32_t slot;
+	uint16_t index;
+	// r | g << 4 | b << 8 as in lightmaps
+	uint16_t light;
+};
+
+static_assert(sizeof(rgbentry) == 8, "light queue entries are packed in 8 bytes");
+
+class BlockLightSolver;
+extern template class LightSolverBase<BlockLightSolver, rgbentry>;
+
+// LightSolver for the red, green and blue channels at once: one traversal
+// updates all three nibbles of a lightmap word, channels that do not
+// change are left alone just as separate solvers would
+class BlockLightSolver : public LightSolverBase<BlockLightSolver, rgbentry> {
+	friend class LightSolverBase<BlockLightSolver, rgbentry>;
+
+	void add(Chunk* chunk, int lx, int ly, int lz, unsigned short emission);
+	void removeNext();
+	void addNext();
+	void drain(LightPartition<rgbentry>& partition);
+public:
+	BlockLightSolver(Chunks* chunks);
+
+	void add(int x, int y, int z);
+	// emission packed as in lightmaps: r | g << 4 | b << 8
+	void add(int x, int y, int z, unsigned short emission);
+	void remove(int x, int y, int z);
+};
+
+#endif /* LIGHTING_BLOCKLIGHTSOLVER_H_ */
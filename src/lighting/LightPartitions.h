@@ -0,0 +1,90 @@
+#ifndef LIGHTING_LIGHTPARTITIONS_H_
+#define LIGHTING_LIGHTPARTITIONS_H_
+
+#include <vector>
+#include <unordered_map>
+#include "../jobs/WorkerPool.h"
+
+class Chunk;
+
+// light additions are split by chunk across the workers when at least this
+// many entries are queued in total; smaller solves take less than a millisecond
+// and lose more to the hand-offs between wavefronts than the workers gain
+#define LIGHT_PARTITION_ENTRIES 32768
+
+// Work of one chunk in a partitioned light solve. Only the job draining
+// a partition writes the lightmap of its chunk, light leaving the chunk
+// is offered to the owning partition through outbox and inbox.
+template<typename T>
+struct LightPartition {
+	Chunk* chunk;
+	// entries already written to the chunk
+	std::vector<T> seeds;
+	// light offered by neighbouring chunks, written where it is brighter
+	std::vector<T> inbox;
+	// light offered to neighbouring chunks, entry.slot is the receiver
+	std::vector<T> outbox;
+	// used while draining, kept for its capacity
+	std::vector<T> queue;
+	bool modified;
+};
+
+// Entries of T need a uint32_t slot member, see Chunks::slots. Partitions
+// are kept between solves so their lists do not have to grow again.
+template<typename T>
+class LightPartitions {
+	std::vector<LightPartition<T>*> partitions;
+	size_t used = 0;
+	std::unordered_map<Chunk*, LightPartition<T>*> owners;
+	std::vector<LightPartition<T>*> active;
+public:
+	~LightPartitions(){
+		for (LightPartition<T>* partition : partitions)
+			delete partition;
+	}
+
+	LightPartition<T>* get(Chunk* chunk){
+		auto found = owners.find(chunk);
+		if (found != owners.end())
+			return found->second;
+		if (used == partitions.size())
+			partitions.push_back(new LightPartition<T>());
+		LightPartition<T>* partition = partitions[used++];
+		partition->chunk = chunk;
+		partition->modified = false;
+		owners[chunk] = partition;
+		return partition;
+	}
+
+	// drains partitions with seeds or inbox entries on the workers, in
+	// wavefronts until no light crosses a chunk border any more; chunks
+	// with changed light are appended to modified
+	template<typename F>
+	void solve(WorkerPool* workers, const std::vector<Chunk*>& slots, F drain, std::vector<Chunk*>& modified){
+		while (true){
+			active.clear();
+			for (size_t i = 0; i < used; i++){
+				if (!partitions[i]->seeds.empty() || !partitions[i]->inbox.empty())
+					active.push_back(partitions[i]);
+			}
+			if (active.empty())
+				break;
+			workers->parallelFor(active.size(), [&](size_t i){
+				drain(*active[i]);
+			});
+			for (LightPartition<T>* partition : active){
+				for (const T& entry : partition->outbox)
+					get(slots[entry.slot])->inbox.push_back(entry);
+				partition->outbox.clear();
+			}
+		}
+		for (size_t i = 0; i < used; i++){
+			if (partitions[i]->modified)
+				modified.push_back(partitions[i]->chunk);
+		}
+		owners.clear();
+		used = 0;
+	}
+};
+
+#endif /* LIGHTING_LIGHTPARTITIONS_H_ */
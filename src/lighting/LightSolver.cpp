@@ -3,28 +3,38 @@
 #include "../voxels/Chunks.h"
 #include "../voxels/Chunk.h"
 #include "../voxels/voxel.h"
+#include "../voxels/VoxelPalette.h"
 #include "../voxels/Block.h"
+#include "../jobs/WorkerPool.h"
 
-LightSolver::LightSolver(Chunks* chunks, int channel) : chunks(chunks), channel(channel) {
+LightSolver::LightSolver(Chunks* chunks, int channel)
+		: LightSolverBase(chunks), channel(channel) {
 }
 
-void LightSolver::add(int x, int y, int z, int emission) {
+void LightSolver::add(Chunk* chunk, int lx, int ly, int lz, int emission) {
 	if (emission <= 1)
 		return;
-	lightentry entry;
-	entry.x = x;
-	entry.y = y;
-	entry.z = z;
-	entry.light = emission;
-	addqueue.push(entry);
-
-	Chunk* chunk = chunks->getChunkByVoxel(entry.x, entry.y, entry.z);
-	chunk->modified = true;
-	chunk->lightmap->set(entry.x-chunk->x*CHUNK_W, entry.y-chunk->y*CHUNK_H, entry.z-chunk->z*CHUNK_D, channel, entry.light);
+	addqueue.push(makeEntry(chunk, lx, ly, lz, emission));
+
+	touch(chunk);
+	chunk->lightmap->set(lx, ly, lz, channel, emission);
+}
+
+void LightSolver::add(int x, int y, int z, int emission) {
+	Chunk* chunk = chunks->getChunkByVoxel(x, y, z);
+	if (chunk == nullptr)
+		return;
+	add(chunk, x-chunk->x*CHUNK_W, y-chunk->y*CHUNK_H, z-chunk->z*CHUNK_D, emission);
 }
 
 void LightSolver::add(int x, int y, int z) {
-	add(x,y,z, chunks->getLight(x,y,z, channel));
+	Chunk* chunk = chunks->getChunkByVoxel(x, y, z);
+	if (chunk == nullptr)
+		return;
+	const int lx = x-chunk->x*CHUNK_W;
+	const int ly = y-chunk->y*CHUNK_H;
+	const int lz = z-chunk->z*CHUNK_D;
+	add(chunk, lx, ly, lz, chunk->lightmap->get(lx, ly, lz, channel));
 }
 
 void LightSolver::remove(int x, int y, int z) {
@@ -32,91 +42,127 @@ void LightSolver::remove(int x, int y, int z) {
 	if (chunk == nullptr)
 		return;
 
-	int light = chunk->lightmap->get(x-chunk->x*CHUNK_W, y-chunk->y*CHUNK_H, z-chunk->z*CHUNK_D, channel);
+	const int lx = x-chunk->x*CHUNK_W;
+	const int ly = y-chunk->y*CHUNK_H;
+	const int lz = z-chunk->z*CHUNK_D;
+	int light = chunk->lightmap->get(lx, ly, lz, channel);
 	if (light == 0){
 		return;
 	}
 
-	lightentry entry;
-	entry.x = x;
-	entry.y = y;
-	entry.z = z;
-	entry.light = light;
-	remqueue.push(entry);
+	remqueue.push(makeEntry(chunk, lx, ly, lz, light));
+
+	chunk->lightmap->set(lx, ly, lz, channel, 0);
+}
+
+inline void LightSolver::removeNext(){
+	const lightentry current = remqueue.front();
+	remqueue.pop();
+	Chunk* const source = chunks->slots[current.slot];
+	int ex, ey, ez;
+	unindex(current.index, ex, ey, ez);
 
-	chunk->lightmap->set(entry.x-chunk->x*CHUNK_W, entry.y-chunk->y*CHUNK_H, entry.z-chunk->z*CHUNK_D, channel, 0);
+	for (size_t i = 0; i < 6; i++) {
+		int x = ex+coords[i*3+0];
+		int y = ey+coords[i*3+1];
+		int z = ez+coords[i*3+2];
+		Chunk* chunk = source->locate(x,y,z);
+		if (chunk) {
+			int light = chunk->lightmap->get(x,y,z, channel);
+			if (light != 0 && light == current.light-1){
+				remqueue.push(makeEntry(chunk, x, y, z, light));
+				chunk->lightmap->set(x,y,z, channel, 0);
+				touch(chunk);
+			}
+			else if (light >= current.light){
+				addqueue.push(makeEntry(chunk, x, y, z, light));
+			}
+		}
+	}
 }
 
-void LightSolver::solve(){
-	const int coords[] = {
-			0, 0, 1,
-			0, 0,-1,
-			0, 1, 0,
-			0,-1, 0,
-			1, 0, 0,
-		   -1, 0, 0
-	};
+inline void LightSolver::addNext(){
+	const lightentry current = addqueue.front();
+	addqueue.pop();
 
-	while (!remqueue.empty()){
-		lightentry entry = remqueue.front();
-		remqueue.pop();
+	if (current.light <= 1)
+		return;
+	Chunk* const source = chunks->slots[current.slot];
+	int ex, ey, ez;
+	unindex(current.index, ex, ey, ez);
+	// removed after it was queued (several removals solved at once)
+	if (source->lightmap->get(ex, ey, ez, channel) != current.light)
+		return;
 
-		for (size_t i = 0; i < 6; i++) {
-			int x = entry.x+coords[i*3+0];
-			int y = entry.y+coords[i*3+1];
-			int z = entry.z+coords[i*3+2];
-			Chunk* chunk = chunks->getChunkByVoxel(x,y,z);
-			if (chunk) {
-				int light = chunks->getLight(x,y,z, channel);
-				if (light != 0 && light == entry.light-1){
-					lightentry nentry;
-					nentry.x = x;
-					nentry.y = y;
-					nentry.z = z;
-					nentry.light = light;
-					remqueue.push(nentry);
-					chunk->lightmap->set(x-chunk->x*CHUNK_W, y-chunk->y*CHUNK_H, z-chunk->z*CHUNK_D, channel, 0);
-					chunk->modified = true;
-				}
-				else if (light >= entry.light){
-					lightentry nentry;
-					nentry.x = x;
-					nentry.y = y;
-					nentry.z = z;
-					nentry.light = light;
-					addqueue.push(nentry);
-				}
+	for (size_t i = 0; i < 6; i++) {
+		int x = ex+coords[i*3+0];
+		int y = ey+coords[i*3+1];
+		int z = ez+coords[i*3+2];
+		Chunk* chunk = source->locate(x,y,z);
+		if (chunk) {
+			int light = chunk->lightmap->get(x,y,z, channel);
+			voxel v = chunk->voxels->get((y * CHUNK_D + z) * CHUNK_W + x);
+			if (Block::lightPassingTable[v.id] && light+2 <= current.light){
+				chunk->lightmap->set(x,y,z, channel, current.light-1);
+				touch(chunk);
+				addqueue.push(makeEntry(chunk, x, y, z, current.light-1));
 			}
 		}
 	}
+}
 
-	while (!addqueue.empty()){
-		lightentry entry = addqueue.front();
-		addqueue.pop();
+// the add loop of solve for the voxels of one chunk, light for the
+// neighbouring chunks goes to the outbox
+void LightSolver::drain(LightPartition<lightentry>& partition){
+	Chunk* const chunk = partition.chunk;
+	Lightmap* const lightmap = chunk->lightmap;
+	std::vector<lightentry>& queue = partition.queue;
+	queue.swap(partition.seeds);
+	for (const lightentry& current : partition.inbox){
+		int ex, ey, ez;
+		unindex(current.index, ex, ey, ez);
+		voxel v = chunk->voxels->get(current.index);
+		if (Block::lightPassingTable[v.id] && lightmap->get(ex, ey, ez, channel) < current.light){
+			lightmap->set(ex, ey, ez, channel, current.light);
+			partition.modified = true;
+			queue.push_back(current);
+		}
+	}
+	partition.inbox.clear();
 
-		if (entry.light <= 1)
+	for (size_t head = 0; head < queue.size(); head++){
+		const lightentry current = queue[head];
+		if (current.light <= 1)
+			continue;
+		int ex, ey, ez;
+		unindex(current.index, ex, ey, ez);
+		if (lightmap->get(ex, ey, ez, channel) != current.light)
 			continue;
 
 		for (size_t i = 0; i < 6; i++) {
-			int x = entry.x+coords[i*3+0];
-			int y = entry.y+coords[i*3+1];
-			int z = entry.z+coords[i*3+2];
-			Chunk* chunk = chunks->getChunkByVoxel(x,y,z);
-			if (chunk) {
-				int light = chunks->getLight(x,y,z, channel);
-				voxel* v = chunks->get(x,y,z);
-				Block* block = Block::blocks[v->id];
-				if (block->lightPassing && light+2 <= entry.light){
-					chunk->lightmap->set(x-chunk->x*CHUNK_W, y-chunk->y*CHUNK_H, z-chunk->z*CHUNK_D, channel, entry.light-1);
-					chunk->modified = true;
-					lightentry nentry;
-					nentry.x = x;
-					nentry.y = y;
-					nentry.z = z;
-					nentry.light = entry.light-1;
-					addqueue.push(nentry);
-				}
+			int x = ex+coords[i*3+0];
+			int y = ey+coords[i*3+1];
+			int z = ez+coords[i*3+2];
+			Chunk* other = chunk->locate(x,y,z);
+			if (other == nullptr)
+				continue;
+			// light of other chunks only grows while adding, so a stale
+			// value that is bright enough is too
+			int light = other->lightmap->get(x,y,z, channel);
+			voxel v = other->voxels->get((y * CHUNK_D + z) * CHUNK_W + x);
+			if (!Block::lightPassingTable[v.id] || light+2 > current.light)
+				continue;
+			if (other != chunk){
+				partition.outbox.push_back(makeEntry(other, x, y, z, current.light-1));
+				continue;
 			}
+			lightmap->set(x,y,z, channel, current.light-1);
+			partition.modified = true;
+			queue.push_back(makeEntry(chunk, x, y, z, current.light-1));
 		}
 	}
+	// seeds and queue swap their storage on each drain, both keep the capacity
+	queue.clear();
 }
+
+template class LightSolverBase<LightSolver, lightentry>;
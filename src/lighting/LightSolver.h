@@ -1,29 +1,40 @@
 #ifndef LIGHTING_LIGHTSOLVER_H_
 #define LIGHTING_LIGHTSOLVER_H_
 
-#include <queue>
+#include <vector>
+#include <stdint.h>
+#include "LightSolverBase.h"
 
 class Chunks;
+class Chunk;
 
 struct lightentry {
-	int x;
-	int y;
-	int z;
-	unsigned char light;
+	// Chunks::slots index of the chunk, neighbours are reached through its links
+	uint32_t slot;
+	// see LIGHT_INDEX
+	uint16_t index;
+	uint8_t light;
 };
 
-class LightSolver {
-	std::queue<lightentry> addqueue;
-	std::queue<lightentry> remqueue;
-	Chunks* chunks;
+static_assert(sizeof(lightentry) == 8, "light queue entries are packed in 8 bytes");
+
+class LightSolver;
+extern template class LightSolverBase<LightSolver, lightentry>;
+
+class LightSolver : public LightSolverBase<LightSolver, lightentry> {
+	friend class LightSolverBase<LightSolver, lightentry>;
 	int channel;
+
+	void add(Chunk* chunk, int lx, int ly, int lz, int emission);
+	void removeNext();
+	void addNext();
+	void drain(LightPartition<lightentry>& partition);
 public:
 	LightSolver(Chunks* chunks, int channel);
 
 	void add(int x, int y, int z);
 	void add(int x, int y, int z, int emission);
 	void remove(int x, int y, int z);
-	void solve();
 };
 
 #endif /* LIGHTING_LIGHTSOLVER_H_ */
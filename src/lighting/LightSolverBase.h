@@ -0,0 +1,135 @@
+#ifndef LIGHTING_LIGHTSOLVERBASE_H_
+#define LIGHTING_LIGHTSOLVERBASE_H_
+
+#include <vector>
+#include <stdint.h>
+#include <algorithm>
+#include "../memory/RingQueue.h"
+#include "../voxels/Chunks.h"
+#include "../voxels/Chunk.h"
+#include "LightPartitions.h"
+
+// capacity each light queue keeps in entries, enough for the edits of a frame;
+// loading chunks grows them for a while (up to about 100k entries when
+// streaming the engine's radius 8 world), see shrink
+#define LIGHT_QUEUE_RESERVE 4096
+
+// voxel index in a chunk as kept by light queue entries
+#define LIGHT_INDEX(x, y, z) (((y) * CHUNK_D + (z)) * CHUNK_W + (x))
+
+// Queues and solve loops shared by LightSolver and BlockLightSolver. S is
+// the solver, it solves the front entry of remqueue and addqueue in
+// removeNext and addNext and the entries of a partition in drain. T is its
+// queue entry, with the uint32_t slot, uint16_t index and light members.
+// Instantiated once, in the source of S, where its solving is inlined.
+template<typename S, typename T>
+class LightSolverBase {
+protected:
+	RingQueue<T> addqueue;
+	RingQueue<T> remqueue;
+	LightPartitions<T> partitions;
+	Chunks* chunks;
+
+	// offsets of the six neighbours of a voxel, x y z each
+	static const int coords[18];
+
+	LightSolverBase(Chunks* chunks)
+		: addqueue(LIGHT_QUEUE_RESERVE), remqueue(LIGHT_QUEUE_RESERVE), chunks(chunks) {
+	}
+
+	static inline T makeEntry(Chunk* chunk, int lx, int ly, int lz, unsigned int light){
+		T entry;
+		entry.slot = chunk->slot;
+		entry.index = LIGHT_INDEX(lx, ly, lz);
+		entry.light = light;
+		return entry;
+	}
+
+	// local coordinates of a LIGHT_INDEX
+	static inline void unindex(uint16_t index, int& lx, int& ly, int& lz){
+		lx = index % CHUNK_W;
+		ly = index / (CHUNK_W * CHUNK_D);
+		lz = index / CHUNK_W % CHUNK_D;
+	}
+
+	inline void touch(Chunk* chunk){
+		if (modified.empty() || modified.back() != chunk)
+			modified.push_back(chunk);
+	}
+public:
+	// chunks with changed light since the last clear, may repeat;
+	// kept here so that solvers of different channels can run on
+	// different threads, Lighting marks them dirty after solving
+	std::vector<Chunk*> modified;
+
+	void solve(){
+		solve(nullptr);
+	}
+
+	// large propagations are split by chunk across the workers, with the
+	// same result as solve(); a single worker solves them as solve() does
+	void solve(WorkerPool* workers);
+	// solves at most budget entries, returns how many were solved
+	size_t step(size_t budget);
+
+	inline bool empty() const {
+		return remqueue.empty() && addqueue.empty();
+	}
+
+	// gives the memory the queues grew past LIGHT_QUEUE_RESERVE back, once solved
+	inline void shrink(){
+		addqueue.shrink();
+		remqueue.shrink();
+	}
+
+	// most entries either queue has held, for sizing LIGHT_QUEUE_RESERVE
+	size_t highWater() const {
+		return std::max(addqueue.highWater(), remqueue.highWater());
+	}
+};
+
+template<typename S, typename T>
+void LightSolverBase<S, T>::solve(WorkerPool* workers){
+	S* solver = static_cast<S*>(this);
+	while (!remqueue.empty())
+		solver->removeNext();
+
+	if (workers && workers->size() > 1 && addqueue.size() >= LIGHT_PARTITION_ENTRIES){
+		while (!addqueue.empty()){
+			const T& entry = addqueue.front();
+			partitions.get(chunks->slots[entry.slot])->seeds.push_back(entry);
+			addqueue.pop();
+		}
+		partitions.solve(workers, chunks->slots, [solver](LightPartition<T>& partition){
+			solver->drain(partition);
+		}, modified);
+		return;
+	}
+
+	while (!addqueue.empty())
+		solver->addNext();
+}
+
+template<typename S, typename T>
+size_t LightSolverBase<S, T>::step(size_t budget){
+	S* solver = static_cast<S*>(this);
+	size_t solved = 0;
+	for (; solved < budget && !remqueue.empty(); solved++)
+		solver->removeNext();
+	// additions start once all removals are done, as in solve
+	for (; solved < budget && remqueue.empty() && !addqueue.empty(); solved++)
+		solver->addNext();
+	return solved;
+}
+
+template<typename S, typename T>
+const int LightSolverBase<S, T>::coords[18] = {
+		0, 0, 1,
+		0, 0,-1,
+		0, 1, 0,
+		0,-1, 0,
+		1, 0, 0,
+	   -1, 0, 0
+};
+
+#endif /* LIGHTING_LIGHTSOLVERBASE_H_ */
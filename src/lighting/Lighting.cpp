@@ -1,152 +1,516 @@
 #include "Lighting.h"
 #include "LightSolver.h"
+#include "BlockLightSolver.h"
 #include "Lightmap.h"
 #include "../voxels/Chunks.h"
 #include "../voxels/Chunk.h"
 #include "../voxels/voxel.h"
+#include "../voxels/VoxelPalette.h"
 #include "../voxels/Block.h"
+#include "../jobs/WorkerPool.h"
+
+#include <vector>
+#include <unordered_set>
+#include <algorithm>
+#include <memory>
 
 Chunks* Lighting::chunks = nullptr;
-LightSolver* Lighting::solverR = nullptr;
-LightSolver* Lighting::solverG = nullptr;
-LightSolver* Lighting::solverB = nullptr;
+BlockLightSolver* Lighting::solverRGB = nullptr;
 LightSolver* Lighting::solverS = nullptr;
+WorkerPool* Lighting::workers = nullptr;
+bool Lighting::budgeted = false;
+std::queue<std::function<size_t()>> Lighting::stages;
+std::vector<Chunk*> Lighting::pending;
+std::vector<ivec3> Lighting::edits;
+bool Lighting::batching = false;
 
-int Lighting::initialize(Chunks* chunks){
+int Lighting::initialize(Chunks* chunks, WorkerPool* workers){
 	Lighting::chunks = chunks;
-	solverR = new LightSolver(chunks, 0);
-	solverG = new LightSolver(chunks, 1);
-	solverB = new LightSolver(chunks, 2);
+	Lighting::workers = workers;
+	solverRGB = new BlockLightSolver(chunks);
 	solverS = new LightSolver(chunks, 3);
 	return 0;
 }
 
 void Lighting::finalize(){
-	delete solverR, solverG, solverB, solverS;
+	delete solverRGB;
+	delete solverS;
+	stages = std::queue<std::function<size_t()>>();
+	pending.clear();
+	edits.clear();
+}
+
+void Lighting::solve(){
+	// block light and sky light use separate bits of the lightmaps and their own queues,
+	// each of them also splits large propagations by chunk
+	if (workers){
+		workers->parallelFor(2, [](size_t i){
+			if (i == 0)
+				solverRGB->solve(workers);
+			else
+				solverS->solve(workers);
+		});
+	} else {
+		solverRGB->solve();
+		solverS->solve();
+	}
+	markModified(true);
+}
+
+void Lighting::markModified(bool settled){
+	for (Chunk* chunk : solverRGB->modified){
+		if (settled)
+			chunks->markDirty(chunk, DIRTY_LIGHT);
+		else
+			hold(chunk);
+	}
+	for (Chunk* chunk : solverS->modified){
+		if (settled)
+			chunks->markDirty(chunk, DIRTY_LIGHT);
+		else
+			hold(chunk);
+	}
+	solverRGB->modified.clear();
+	solverS->modified.clear();
+}
+
+void Lighting::hold(Chunk* chunk){
+	if (chunk == nullptr)
+		return;
+	if (!(chunk->dirty & DIRTY_PENDING))
+		pending.push_back(chunk);
+	// remeshed once released, whether or not its light changed in the end
+	chunks->markDirty(chunk, DIRTY_LIGHT | DIRTY_PENDING);
+}
+
+void Lighting::hold(int x1, int y1, int z1, int x2, int y2, int z2){
+	if (!budgeted)
+		return;
+	for (int cy = floordiv(y1, CHUNK_H); cy <= floordiv(y2-1, CHUNK_H); cy++){
+		for (int cz = floordiv(z1, CHUNK_D); cz <= floordiv(z2-1, CHUNK_D); cz++){
+			for (int cx = floordiv(x1, CHUNK_W); cx <= floordiv(x2-1, CHUNK_W); cx++){
+				hold(chunks->getChunk(cx, cy, cz));
+			}
+		}
+	}
+}
+
+void Lighting::release(){
+	for (Chunk* chunk : pending)
+		chunk->dirty &= ~DIRTY_PENDING;
+	pending.clear();
+}
+
+void Lighting::stage(std::function<size_t()> seed){
+	if (budgeted){
+		stages.push(std::move(seed));
+		return;
+	}
+	seed();
+	solve();
+}
+
+void Lighting::setBudgeted(bool budgeted){
+	if (!budgeted)
+		finish();
+	Lighting::budgeted = budgeted;
+}
+
+bool Lighting::update(size_t budget){
+	while (budget > 0){
+		// the next stage is seeded once the light before it is solved
+		if (solverRGB->empty() && solverS->empty()){
+			if (stages.empty())
+				break;
+			std::function<size_t()> seed = std::move(stages.front());
+			stages.pop();
+			budget -= std::min(budget, seed());
+			continue;
+		}
+		size_t solved[2];
+		if (workers){
+			workers->parallelFor(2, [&solved, budget](size_t i){
+				if (i == 0)
+					solved[0] = solverRGB->step(budget);
+				else
+					solved[1] = solverS->step(budget);
+			});
+		} else {
+			solved[0] = solverRGB->step(budget);
+			solved[1] = solverS->step(budget);
+		}
+		budget -= std::min(budget, std::max(solved[0], solved[1]));
+	}
+	const bool settled = stages.empty() && solverRGB->empty() && solverS->empty();
+	markModified(settled);
+	if (settled){
+		release();
+		solverRGB->shrink();
+		solverS->shrink();
+	}
+	return settled;
+}
+
+void Lighting::finish(){
+	solve();
+	while (!stages.empty()){
+		std::function<size_t()> seed = std::move(stages.front());
+		stages.pop();
+		seed();
+		solve();
+	}
+	release();
+	solverRGB->shrink();
+	solverS->shrink();
+}
+
+size_t Lighting::queuesHighWater(){
+	return std::max(solverRGB->highWater(), solverS->highWater());
 }
 
 void Lighting::clear(){
-	for (unsigned int y = 0; y < chunks->h; y++){
-		for (unsigned int z = 0; z < chunks->d; z++){
-			for (unsigned int x = 0; x < chunks->w; x++){
-				Chunk* chunk = chunks->getChunk(x,y,z);
-				Lightmap* lightmap = chunk->lightmap;
-				for (int i = 0; i < CHUNK_VOL; i++){
-					lightmap->map[i] = 0;
+	for (auto& entry : chunks->chunks){
+		entry.second->lightmap->fill(0);
+	}
+}
+
+// sky light at local coordinates at most one chunk outside of chunk,
+// 0 where no chunk is loaded as in Chunks::getLight
+static inline int skyAt(Chunk* chunk, int lx, int ly, int lz){
+	Chunk* other = chunk->locate(lx, ly, lz);
+	if (other == nullptr)
+		return 0;
+	return other->lightmap->getS(lx, ly, lz);
+}
+
+// calls f(x,y,z) for the voxels of chunks outside of lighting that touch a face of
+// one of the loaded chunks, returns the number of calls
+template<typename F>
+static size_t forEachBorder(const std::vector<Chunk*>& loaded, const std::unordered_set<Chunk*>& lighting, F f){
+	const int faces[] = {
+			0, 0, 1,
+			0, 0,-1,
+			0, 1, 0,
+			0,-1, 0,
+			1, 0, 0,
+		   -1, 0, 0
+	};
+	size_t visited = 0;
+	for (Chunk* chunk : loaded){
+		for (int i = 0; i < 6; i++){
+			const int dx = faces[i*3+0];
+			const int dy = faces[i*3+1];
+			const int dz = faces[i*3+2];
+			Chunk* other = chunk->neighbours[((dy+1) * 3 + dz+1) * 3 + dx+1];
+			if (other == nullptr || lighting.count(other))
+				continue;
+			// the layer of other facing chunk
+			for (int ly = dy < 0 ? CHUNK_H-1 : 0; ly < (dy > 0 ? 1 : CHUNK_H); ly++){
+				for (int lz = dz < 0 ? CHUNK_D-1 : 0; lz < (dz > 0 ? 1 : CHUNK_D); lz++){
+					for (int lx = dx < 0 ? CHUNK_W-1 : 0; lx < (dx > 0 ? 1 : CHUNK_W); lx++){
+						f(lx + other->x * CHUNK_W, ly + other->y * CHUNK_H, lz + other->z * CHUNK_D);
+						visited++;
+					}
 				}
 			}
 		}
 	}
+	return visited;
 }
 
 void Lighting::onWorldLoaded(){
-	for (int y = 0; y < chunks->h*CHUNK_H; y++){
-		for (int z = 0; z < chunks->d*CHUNK_D; z++){
-			for (int x = 0; x < chunks->w*CHUNK_W; x++){
-				voxel* vox = chunks->get(x,y,z);
-				Block* block = Block::blocks[vox->id];
-				if (block->emission[0] || block->emission[1] || block->emission[2]){
-					solverR->add(x,y,z,block->emission[0]);
-					solverG->add(x,y,z,block->emission[1]);
-					solverB->add(x,y,z,block->emission[2]);
+	std::vector<Chunk*> loaded;
+	loaded.reserve(chunks->chunks.size());
+	for (auto& entry : chunks->chunks){
+		loaded.push_back(entry.second);
+	}
+	onChunksLoaded(loaded);
+}
+
+void Lighting::onChunksLoaded(const std::vector<Chunk*>& loaded){
+	if (loaded.empty())
+		return;
+	if (budgeted){
+		for (Chunk* chunk : loaded)
+			hold(chunk);
+	}
+
+	stage([loaded](){
+		std::unordered_set<Chunk*> lighting(loaded.begin(), loaded.end());
+		const int top = chunks->h * CHUNK_H;
+
+		// light that chunks around may still have from chunks once at these places;
+		// emitters on the border give the same light again, voxels open to the sky
+		// keep their full sky light
+		return forEachBorder(loaded, lighting, [top](int x, int y, int z){
+			solverRGB->remove(x,y,z);
+			unsigned short emission = Block::emissionTable[chunks->get(x,y,z).id];
+			if (emission)
+				solverRGB->add(x,y,z,emission);
+			if (chunks->getHeight(x,top,z) > y)
+				solverS->remove(x,y,z);
+		});
+	});
+
+	// sky light falls down to the ground of each column (grounds are in chunk rows);
+	// filled a layer at a time, chunks above the ground everywhere stay uniform
+	std::shared_ptr<std::vector<uint8_t>> grounds(new std::vector<uint8_t>(loaded.size() * CHUNK_D * CHUNK_W));
+	stage([loaded, grounds](){
+		const int top = chunks->h * CHUNK_H;
+		for (size_t i = 0; i < loaded.size(); i++){
+			Chunk* chunk = loaded[i];
+			uint8_t* ground = &(*grounds)[i * CHUNK_D * CHUNK_W];
+			for (int lz = 0; lz < CHUNK_D; lz++){
+				for (int lx = 0; lx < CHUNK_W; lx++){
+					int height = chunks->getHeight(lx + chunk->x * CHUNK_W, top, lz + chunk->z * CHUNK_D);
+					height = std::min(std::max(height - chunk->y * CHUNK_H, 0), CHUNK_H);
+					ground[lz * CHUNK_W + lx] = height;
 				}
 			}
+			chunk->lightmap->fillSky(ground);
 		}
+		return grounds->size();
+	});
+
+	// when budgeted a few chunks are seeded at a time, so that no update scans them all
+	const size_t group = budgeted ? LIGHT_SEED_CHUNKS : loaded.size();
+	for (size_t first = 0; first < loaded.size(); first += group){
+		std::vector<Chunk*> part(loaded.begin() + first, loaded.begin() + std::min(first + group, loaded.size()));
+		stage([part, grounds, first](){
+			return seedChunks(part, &(*grounds)[first * CHUNK_D * CHUNK_W]);
+		});
 	}
 
-	for (int z = 0; z < chunks->d*CHUNK_D; z++){
-		for (int x = 0; x < chunks->w*CHUNK_W; x++){
-			for (int y = chunks->h*CHUNK_H-1; y >= 0; y--){
-				voxel* vox = chunks->get(x,y,z);
-				if (vox->id != 0){
-					break;
+	// and light of the chunks around flows in
+	stage([loaded](){
+		std::unordered_set<Chunk*> lighting(loaded.begin(), loaded.end());
+		return forEachBorder(loaded, lighting, [](int x, int y, int z){
+			solverRGB->add(x,y,z);
+			solverS->add(x,y,z);
+		});
+	});
+}
+
+size_t Lighting::seedChunks(const std::vector<Chunk*>& loaded, const uint8_t* grounds){
+	size_t visited = 0;
+	for (size_t i = 0; i < loaded.size(); i++){
+		Chunk* chunk = loaded[i];
+		VoxelPalette* voxels = chunk->voxels;
+		if (voxels->isUniform() && !Block::emissionTable[voxels->get(0).id])
+			continue;
+		visited += CHUNK_VOL;
+		for (int ly = 0; ly < CHUNK_H; ly++){
+			for (int lz = 0; lz < CHUNK_D; lz++){
+				for (int lx = 0; lx < CHUNK_W; lx++){
+					voxel vox = voxels->get((ly * CHUNK_D + lz) * CHUNK_W + lx);
+					unsigned short emission = Block::emissionTable[vox.id];
+					if (emission){
+						int x = lx + chunk->x * CHUNK_W;
+						int y = ly + chunk->y * CHUNK_H;
+						int z = lz + chunk->z * CHUNK_D;
+						solverRGB->add(x,y,z,emission);
+					}
 				}
-				chunks->getChunkByVoxel(x,y,z)->lightmap->setS(x % CHUNK_W, y % CHUNK_H, z % CHUNK_D, 0xF);
 			}
 		}
 	}
 
-	for (int z = 0; z < chunks->d*CHUNK_D; z++){
-		for (int x = 0; x < chunks->w*CHUNK_W; x++){
-			for (int y = chunks->h*CHUNK_H-1; y >= 0; y--){
-				voxel* vox = chunks->get(x,y,z);
-				if (vox->id != 0){
-					break;
-				}
-				if (
-						chunks->getLight(x-1,y,z, 3) == 0 ||
-						chunks->getLight(x+1,y,z, 3) == 0 ||
-						chunks->getLight(x,y-1,z, 3) == 0 ||
-						chunks->getLight(x,y+1,z, 3) == 0 ||
-						chunks->getLight(x,y,z-1, 3) == 0 ||
-						chunks->getLight(x,y,z+1, 3) == 0
-						){
-					solverS->add(x,y,z);
+	// sky light spreads sideways from voxels next to darker ones
+	for (size_t i = 0; i < loaded.size(); i++){
+		Chunk* chunk = loaded[i];
+		const uint8_t* ground = &grounds[i * CHUNK_D * CHUNK_W];
+		const bool open = std::all_of(ground, ground + CHUNK_D * CHUNK_W, [](uint8_t height){
+			return height == 0;
+		});
+		for (int ly = 0; ly < CHUNK_H; ly++){
+			for (int lz = 0; lz < CHUNK_D; lz++){
+				for (int lx = 0; lx < CHUNK_W; lx++){
+					if (ly < ground[lz * CHUNK_W + lx])
+						continue;
+					// interior voxels of an open chunk have only lit neighbours
+					if (open && lx > 0 && lx < CHUNK_W-1 && ly > 0 && ly < CHUNK_H-1 && lz > 0 && lz < CHUNK_D-1)
+						continue;
+					visited++;
+					if (
+							skyAt(chunk, lx-1,ly,lz) < 0xE ||
+							skyAt(chunk, lx+1,ly,lz) < 0xE ||
+							skyAt(chunk, lx,ly-1,lz) < 0xE ||
+							skyAt(chunk, lx,ly+1,lz) < 0xE ||
+							skyAt(chunk, lx,ly,lz-1) < 0xE ||
+							skyAt(chunk, lx,ly,lz+1) < 0xE
+							){
+						solverS->add(lx + chunk->x * CHUNK_W, ly + chunk->y * CHUNK_H, lz + chunk->z * CHUNK_D);
+					}
 				}
-				chunks->getChunkByVoxel(x,y,z)->lightmap->setS(x % CHUNK_W, y % CHUNK_H, z % CHUNK_D, 0xF);
 			}
 		}
 	}
+	return visited;
+}
+
+void Lighting::onChunksChanged(const std::vector<Chunk*>& changed){
+	// sky light of the chunks below depends on the changed ones
+	std::unordered_set<Chunk*> relit;
+	std::vector<Chunk*> loaded;
+	for (Chunk* chunk : changed){
+		for (; chunk && relit.insert(chunk).second; chunk = chunk->neighbours[4]){
+			loaded.push_back(chunk);
+		}
+	}
+	if (loaded.empty())
+		return;
+	// cleared only once the light before is solved, then lit as if just loaded
+	stage([loaded](){
+		for (Chunk* chunk : loaded)
+			chunk->lightmap->fill(0);
+		return loaded.size();
+	});
+	onChunksLoaded(loaded);
+}
+
+void Lighting::onBlockSet(int x, int y, int z){
+	hold(x-1, y-1, z-1, x+2, y+2, z+2);
+	edits.push_back(ivec3(x, y, z));
+	if (!batching)
+		lightEdits();
+}
 
-	solverR->solve();
-	solverG->solve();
-	solverB->solve();
-	solverS->solve();
+void Lighting::beginBatch(){
+	batching = true;
 }
 
-void Lighting::onBlockSet(int x, int y, int z, int id){
-	if (id == 0){
-		solverR->remove(x,y,z);
-		solverG->remove(x,y,z);
-		solverB->remove(x,y,z);
+void Lighting::endBatch(){
+	batching = false;
+	lightEdits();
+}
 
-		solverR->solve();
-		solverG->solve();
-		solverB->solve();
+void Lighting::lightEdits(){
+	if (edits.empty())
+		return;
+	std::vector<ivec3> edited;
+	edited.swap(edits);
 
-		if (chunks->getLight(x,y+1,z, 3) == 0xF){
-			for (int i = y; i >= 0; i--){
-				if (chunks->get(x,i,z)->id != 0)
-					break;
-				solverS->add(x,i,z, 0xF);
+	stage([edited](){
+		for (const ivec3& pos : edited){
+			const int x = pos.x;
+			const int y = pos.y;
+			const int z = pos.z;
+			solverRGB->remove(x,y,z);
+			if (chunks->get(x,y,z).id == 0)
+				continue;
+			// a block also shades the sky light below it
+			solverS->remove(x,y,z);
+			const int ground = std::min(chunks->getHeight(x,y,z), y-1);
+			for (int i = y-1; i >= std::max(ground, 0); i--){
+				solverS->remove(x,i,z);
 			}
 		}
+		return edited.size();
+	});
 
-		solverR->add(x,y+1,z); solverG->add(x,y+1,z); solverB->add(x,y+1,z); solverS->add(x,y+1,z);
-		solverR->add(x,y-1,z); solverG->add(x,y-1,z); solverB->add(x,y-1,z); solverS->add(x,y-1,z);
-		solverR->add(x+1,y,z); solverG->add(x+1,y,z); solverB->add(x+1,y,z); solverS->add(x+1,y,z);
-		solverR->add(x-1,y,z); solverG->add(x-1,y,z); solverB->add(x-1,y,z); solverS->add(x-1,y,z);
-		solverR->add(x,y,z+1); solverG->add(x,y,z+1); solverB->add(x,y,z+1); solverS->add(x,y,z+1);
-		solverR->add(x,y,z-1); solverG->add(x,y,z-1); solverB->add(x,y,z-1); solverS->add(x,y,z-1);
+	stage([edited](){
+		for (const ivec3& pos : edited){
+			const int x = pos.x;
+			const int y = pos.y;
+			const int z = pos.z;
+			const int id = chunks->get(x,y,z).id;
+			unsigned short emission = Block::emissionTable[id];
+			if (emission)
+				solverRGB->add(x,y,z,emission);
+			if (id == 0){
+				// the column is open to the sky down to its new top
+				const int ground = chunks->getHeight(x, chunks->h * CHUNK_H, z);
+				for (int i = y; i >= ground; i--){
+					solverS->add(x,i,z, 0xF);
+				}
+			}
+			// light around flows into blocks that let it pass, glass too
+			if (!Block::lightPassingTable[id])
+				continue;
 
-		solverR->solve();
-		solverG->solve();
-		solverB->solve();
-		solverS->solve();
-	} else {
-		solverR->remove(x,y,z);
-		solverG->remove(x,y,z);
-		solverB->remove(x,y,z);
-		solverS->remove(x,y,z);
-		for (int i = y-1; i >= 0; i--){
-			solverS->remove(x,i,z);
-			if (i == 0 || chunks->get(x,i-1,z)->id != 0){
-				break;
+			solverRGB->add(x,y+1,z); solverS->add(x,y+1,z);
+			solverRGB->add(x,y-1,z); solverS->add(x,y-1,z);
+			solverRGB->add(x+1,y,z); solverS->add(x+1,y,z);
+			solverRGB->add(x-1,y,z); solverS->add(x-1,y,z);
+			solverRGB->add(x,y,z+1); solverS->add(x,y,z+1);
+			solverRGB->add(x,y,z-1); solverS->add(x,y,z-1);
+		}
+		return edited.size();
+	});
+}
+
+void Lighting::onRegionSet(int x1, int y1, int z1, int x2, int y2, int z2){
+	if (x1 >= x2 || y1 >= y2 || z1 >= z2)
+		return;
+	hold(x1-1, y1-1, z1-1, x2+1, y2+1, z2+1);
+
+	stage([x1, y1, z1, x2, y2, z2](){
+		// light of the region and the sky light falling through it to the columns below
+		for (int y = y1; y < y2; y++){
+			for (int z = z1; z < z2; z++){
+				for (int x = x1; x < x2; x++){
+					solverRGB->remove(x,y,z);
+					solverS->remove(x,y,z);
+				}
 			}
 		}
-		solverR->solve();
-		solverG->solve();
-		solverB->solve();
-		solverS->solve();
+		for (int z = z1; z < z2; z++){
+			for (int x = x1; x < x2; x++){
+				const int ground = chunks->getHeight(x,y1,z);
+				for (int i = y1-1; i >= ground; i--){
+					solverS->remove(x,i,z);
+				}
+			}
+		}
+		return (size_t)(x2-x1) * (y2-y1) * (z2-z1);
+	});
 
-		Block* block = Block::blocks[id];
-		if (block->emission[0] || block->emission[1] || block->emission[2]){
-			solverR->add(x,y,z,block->emission[0]);
-			solverG->add(x,y,z,block->emission[1]);
-			solverB->add(x,y,z,block->emission[2]);
-			solverR->solve();
-			solverG->solve();
-			solverB->solve();
+	stage([x1, y1, z1, x2, y2, z2](){
+		// emitters and sky light entering open columns from above
+		for (int y = y1; y < y2; y++){
+			for (int z = z1; z < z2; z++){
+				for (int x = x1; x < x2; x++){
+					unsigned short emission = Block::emissionTable[chunks->get(x,y,z).id];
+					if (emission){
+						solverRGB->add(x,y,z,emission);
+					}
+				}
+			}
 		}
-	}
+		for (int z = z1; z < z2; z++){
+			for (int x = x1; x < x2; x++){
+				const int ground = chunks->getHeight(x, chunks->h * CHUNK_H, z);
+				if (ground > y2)
+					continue;
+				for (int i = y2-1; i >= ground; i--){
+					solverS->add(x,i,z, 0xF);
+				}
+			}
+		}
+
+		// light around the region flows back in
+		auto addAround = [](int x, int y, int z){
+			solverRGB->add(x,y,z);
+			solverS->add(x,y,z);
+		};
+		for (int y = y1; y < y2; y++){
+			for (int z = z1; z < z2; z++){
+				addAround(x1-1,y,z);
+				addAround(x2,y,z);
+			}
+		}
+		for (int y = y1; y < y2; y++){
+			for (int x = x1; x < x2; x++){
+				addAround(x,y,z1-1);
+				addAround(x,y,z2);
+			}
+		}
+		for (int z = z1; z < z2; z++){
+			for (int x = x1; x < x2; x++){
+				addAround(x,y1-1,z);
+				addAround(x,y2,z);
+			}
+		}
+		return (size_t)(x2-x1) * (y2-y1) * (z2-z1);
+	});
 }
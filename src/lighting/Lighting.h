@@ -1,22 +1,88 @@
 #ifndef LIGHTING_LIGHTING_H_
 #define LIGHTING_LIGHTING_H_
 
+#include <stdlib.h>
+#include <stdint.h>
+#include <vector>
+#include <queue>
+#include <functional>
+#include <glm/glm.hpp>
+
+using namespace glm;
+
 class Chunks;
+class Chunk;
 class LightSolver;
+class BlockLightSolver;
+class WorkerPool;
+
+// chunks seeded per stage of Lighting::onChunksLoaded when budgeted, their
+// voxels are scanned within the budget of an update
+#define LIGHT_SEED_CHUNKS 8
 
 class Lighting {
 	static Chunks* chunks;
-	static LightSolver* solverR;
-	static LightSolver* solverG;
-	static LightSolver* solverB;
+	static BlockLightSolver* solverRGB;
 	static LightSolver* solverS;
+	static WorkerPool* workers;
+	// light of edits is solved over frames by update instead of right away
+	static bool budgeted;
+	// seeds of light work waiting for the work before them to be solved,
+	// each returns the voxels it visited, counted as entries by update
+	static std::queue<std::function<size_t()>> stages;
+	// chunks kept from being remeshed until their light settles, see DIRTY_PENDING
+	static std::vector<Chunk*> pending;
+	// voxels set since the edits were last lit, see beginBatch
+	static std::vector<ivec3> edits;
+	static bool batching;
+
+	// solves block and sky light, on the workers if there are any
+	static void solve();
+	// runs seed and solves the light it queued, or leaves both to update when budgeted
+	static void stage(std::function<size_t()> seed);
+	static void hold(Chunk* chunk);
+	// holds the chunks of [x1,x2) x [y1,y2) x [z1,z2) when budgeted
+	static void hold(int x1, int y1, int z1, int x2, int y2, int z2);
+	// marks chunks with changed light, held while their light is not settled
+	static void markModified(bool settled);
+	static void release();
+	// lights the voxels in edits with one removal and one addition solve
+	static void lightEdits();
+	// queues the emitters of loaded chunks and their sky light spreading from the
+	// grounds filled by onChunksLoaded, returns the voxels visited
+	static size_t seedChunks(const std::vector<Chunk*>& loaded, const uint8_t* grounds);
 public:
-	static int initialize(Chunks* chunks);
+	static int initialize(Chunks* chunks, WorkerPool* workers);
 	static void finalize();
 
 	static void clear();
 	static void onWorldLoaded();
-	static void onBlockSet(int x, int y, int z, int id);
+	// lights chunks that were just put (with empty lightmaps) from their emitters,
+	// sky columns and the chunks around them, without relighting the rest
+	static void onChunksLoaded(const std::vector<Chunk*>& loaded);
+	// relights chunks with replaced voxels and the chunks below them, see Chunks::read
+	static void onChunksChanged(const std::vector<Chunk*>& changed);
+	// relights after the voxel at x,y,z was set, its new id is read from chunks
+	static void onBlockSet(int x, int y, int z);
+	// for scripted edits of many scattered voxels (builds, explosions): voxels
+	// set between beginBatch and endBatch are lit together by endBatch, with
+	// the same result as lighting them one by one; boxes go to onRegionSet
+	static void beginBatch();
+	static void endBatch();
+	// relights after a region edit of [x1,x2) x [y1,y2) x [z1,z2), see Chunks::fill
+	static void onRegionSet(int x1, int y1, int z1, int x2, int y2, int z2);
+
+	// when budgeted, edits and loaded chunks are lit by update over several frames;
+	// unsetting it finishes the light work in flight
+	static void setBudgeted(bool budgeted);
+	// solves at most budget light entries per solver of the queued light work,
+	// seeding included, returns true when all of it is done and no chunk is held any more
+	static bool update(size_t budget);
+	// solves all queued light work at once, needed before chunks are unloaded
+	static void finish();
+
+	// most entries any light queue has held so far
+	static size_t queuesHighWater();
 };
 
 #endif /* LIGHTING_LIGHTING_H_ */
@@ -1,12 +1,98 @@
 #include "Lightmap.h"
+#include "../memory/MemoryPool.h"
+
+#include <mutex>
+#include <string.h>
+#include <algorithm>
+
+static MemoryPool rgbMaps(sizeof(unsigned short) * CHUNK_VOL, 32);
+static MemoryPool skyMaps(sizeof(unsigned short) * CHUNK_VOL / 4, 64);
+static MemoryPool objects(sizeof(Lightmap), 256);
+static_assert(sizeof(std::atomic<unsigned short>) == sizeof(unsigned short), "light words must stay 16 bit");
+static_assert(CHUNK_VOL % 4 == 0, "sky light words hold four voxels");
+static_assert(CHUNK_D * CHUNK_W % 16 == 0, "sky light layers are filled in 64-bit words");
+
+// taken by the first channel writing to a uniform plane
+static std::mutex materializing;
 
 Lightmap::Lightmap(){
-	map = new unsigned short[CHUNK_VOL];
-	for (unsigned int i = 0; i < CHUNK_VOL; i++){
-		map[i] = 0x0000;
-	}
 }
 
 Lightmap::~Lightmap(){
-	delete[] map;
+	if (!rgb.isUniform())
+		rgbMaps.release(rgb.map);
+	if (!sky.isUniform())
+		skyMaps.release(sky.map);
+}
+
+void* Lightmap::operator new(size_t){
+	return objects.allocate();
+}
+
+void Lightmap::operator delete(void* ptr){
+	objects.release(ptr);
+}
+
+void Lightmap::materialize(LightPlane& plane){
+	std::lock_guard<std::mutex> lock(materializing);
+	if (plane.map.load(std::memory_order_relaxed) != &plane.value)
+		return;
+	const bool skyPlane = &plane == &sky;
+	const unsigned int count = skyPlane ? CHUNK_VOL / 4 : CHUNK_VOL;
+	std::atomic<unsigned short>* words = (std::atomic<unsigned short>*)(skyPlane ? skyMaps : rgbMaps).allocate();
+	const unsigned short current = plane.value.load(std::memory_order_relaxed);
+	for (unsigned int i = 0; i < count; i++){
+		words[i].store(current, std::memory_order_relaxed);
+	}
+	plane.map.store(words, std::memory_order_release);
+}
+
+void Lightmap::fill(unsigned short value){
+	if (!rgb.isUniform())
+		rgbMaps.release(rgb.map);
+	if (!sky.isUniform())
+		skyMaps.release(sky.map);
+	rgb.value = value & 0x0FFF;
+	rgb.map = &rgb.value;
+	sky.value = (value >> 12) * 0x1111;
+	sky.map = &sky.value;
+}
+
+void Lightmap::fillSky(const uint8_t* ground){
+	int lowest = CHUNK_H;
+	int highest = 0;
+	for (int i = 0; i < CHUNK_D*CHUNK_W; i++){
+		lowest = std::min(lowest, (int)ground[i]);
+		highest = std::max(highest, (int)ground[i]);
+	}
+	if (lowest == CHUNK_H)
+		return;
+	if (sky.isUniform()){
+		if (highest == 0 || sky.value == 0xFFFF){
+			sky.value = 0xFFFF;
+			return;
+		}
+		materialize(sky);
+	}
+
+	// nibbles of the columns lit in the current layer
+	unsigned short lit[CHUNK_D*CHUNK_W/4] = {};
+	char* words = (char*)sky.map.load(std::memory_order_relaxed);
+	for (int y = lowest; y < CHUNK_H; y++){
+		for (int i = 0; i < CHUNK_D*CHUNK_W; i++){
+			if (ground[i] == y)
+				lit[i >> 2] |= 0xF << ((i & 3) << 2);
+		}
+		// no other thread touches the plane here, so the layer is or-ed in
+		// 64 bits at a time instead of through the atomic words
+		char* layer = words + y * sizeof(lit);
+		for (size_t offset = 0; offset < sizeof(lit); offset += sizeof(uint64_t)){
+			uint64_t word;
+			uint64_t light;
+			memcpy(&word, layer + offset, sizeof(word));
+			memcpy(&light, (char*)lit + offset, sizeof(light));
+			word |= light;
+			memcpy(layer + offset, &word, sizeof(word));
+		}
+	}
 }
@@ -1,57 +1,138 @@
 #ifndef LIGHTING_LIGHTMAP_H_
 #define LIGHTING_LIGHTMAP_H_
 
+#include <stdlib.h>
+#include <stdint.h>
+#include <atomic>
 #include "../voxels/Chunk.h"
 
-class Lightmap {
+// Words of one light plane. A uniform plane keeps a single word (map
+// points to value) until the first write of something else allocates
+// the full array, see Lightmap::materialize.
+struct LightPlane {
+	std::atomic<unsigned short> value;
+	std::atomic<std::atomic<unsigned short>*> map;
+
+	LightPlane() : value(0), map(&value) {}
+
+	inline bool isUniform() const {
+		return map.load(std::memory_order_acquire) == &value;
+	}
+
+	inline std::atomic<unsigned short>& word(int index){
+		// map is loaded once: the array is published with its words set,
+		// so either layout read through it is consistent
+		std::atomic<unsigned short>* const words = map.load(std::memory_order_acquire);
+		return words == &value ? value : words[index];
+	}
+};
+
+// Block light (r | g << 4 | b << 8 in 16-bit words, 8 KiB) and sky light
+// (4-bit nibbles, 2 KiB) are separate planes, so chunks above the ground
+// allocate nothing and chunks lit only by the sky just the nibbles.
+// Each write is an atomic xor of its own bits, so block and sky light
+// may be solved on different threads at the same time.
+class Lightmap final {
+	LightPlane rgb;
+	// a uniform sky plane repeats its nibble in all four of value
+	LightPlane sky;
+
+	void materialize(LightPlane& plane);
+
+	// writes the bits of light selected by bits, which belong to the calling solver
+	inline void storeBits(LightPlane& plane, int index, unsigned short bits, unsigned short light){
+		const unsigned short current = plane.word(index).load(std::memory_order_relaxed);
+		const unsigned short delta = (current ^ light) & bits;
+		if (delta == 0)
+			return;
+		if (plane.isUniform())
+			materialize(plane);
+		plane.word(index).fetch_xor(delta, std::memory_order_relaxed);
+	}
+
+	inline void store(int index, int shift, int light){
+		storeBits(rgb, index, 0xF << shift, light << shift);
+	}
+
+	inline unsigned char load(int index, int shift){
+		return (rgb.word(index).load(std::memory_order_relaxed) >> shift) & 0xF;
+	}
+
+	inline void storeS(int index, int light){
+		const int shift = (index & 3) << 2;
+		storeBits(sky, index >> 2, 0xF << shift, light << shift);
+	}
+
+	inline unsigned char loadS(int index){
+		return (sky.word(index >> 2).load(std::memory_order_relaxed) >> ((index & 3) << 2)) & 0xF;
+	}
 public:
-	unsigned short* map;
 	Lightmap();
 	~Lightmap();
 
+	// objects come from a pool of sizeof(Lightmap), the class is final for that
+	static void* operator new(size_t);
+	static void operator delete(void* ptr);
+
+	void fill(unsigned short value);
+	// sky light 0xF from ground[z*CHUNK_W+x] up to the top of each column,
+	// a layer at a time; not to be called while the sky light is solved
+	void fillSky(const uint8_t* ground);
+
 	inline unsigned char get(int x, int y, int z, int channel){
-		return (map[y*CHUNK_D*CHUNK_W+z*CHUNK_W+x] >> (channel << 2)) & 0xF;
+		const int index = y*CHUNK_D*CHUNK_W+z*CHUNK_W+x;
+		if (channel == 3)
+			return loadS(index);
+		return load(index, channel << 2);
 	}
 
 	inline unsigned char getR(int x, int y, int z){
-		return map[y*CHUNK_D*CHUNK_W+z*CHUNK_W+x] & 0xF;
+		return load(y*CHUNK_D*CHUNK_W+z*CHUNK_W+x, 0);
 	}
 
 	inline unsigned char getG(int x, int y, int z){
-		return (map[y*CHUNK_D*CHUNK_W+z*CHUNK_W+x] >> 4) & 0xF;
+		return load(y*CHUNK_D*CHUNK_W+z*CHUNK_W+x, 4);
 	}
 
 	inline unsigned char getB(int x, int y, int z){
-		return (map[y*CHUNK_D*CHUNK_W+z*CHUNK_W+x] >> 8) & 0xF;
+		return load(y*CHUNK_D*CHUNK_W+z*CHUNK_W+x, 8);
 	}
 
 	inline unsigned char getS(int x, int y, int z){
-		return (map[y*CHUNK_D*CHUNK_W+z*CHUNK_W+x] >> 12) & 0xF;
+		return loadS(y*CHUNK_D*CHUNK_W+z*CHUNK_W+x);
+	}
+
+	// red, green and blue at once: r | g << 4 | b << 8
+	inline unsigned short getRGB(int x, int y, int z){
+		return rgb.word(y*CHUNK_D*CHUNK_W+z*CHUNK_W+x).load(std::memory_order_relaxed) & 0x0FFF;
+	}
+
+	inline void setRGB(int x, int y, int z, unsigned short value){
+		storeBits(rgb, y*CHUNK_D*CHUNK_W+z*CHUNK_W+x, 0x0FFF, value);
 	}
 
 	inline void setR(int x, int y, int z, int value){
-		const int index = y*CHUNK_D*CHUNK_W+z*CHUNK_W+x;
-		map[index] = (map[index] & 0xFFF0) | value;
+		store(y*CHUNK_D*CHUNK_W+z*CHUNK_W+x, 0, value);
 	}
 
 	inline void setG(int x, int y, int z, int value){
-		const int index = y*CHUNK_D*CHUNK_W+z*CHUNK_W+x;
-		map[index] = (map[index] & 0xFF0F) | (value << 4);
+		store(y*CHUNK_D*CHUNK_W+z*CHUNK_W+x, 4, value);
 	}
 
 	inline void setB(int x, int y, int z, int value){
-		const int index = y*CHUNK_D*CHUNK_W+z*CHUNK_W+x;
-		map[index] = (map[index] & 0xF0FF) | (value << 8);
+		store(y*CHUNK_D*CHUNK_W+z*CHUNK_W+x, 8, value);
 	}
 
 	inline void setS(int x, int y, int z, int value){
-		const int index = y*CHUNK_D*CHUNK_W+z*CHUNK_W+x;
-		map[index] = (map[index] & 0x0FFF) | (value << 12);
+		storeS(y*CHUNK_D*CHUNK_W+z*CHUNK_W+x, value);
 	}
 
 	inline void set(int x, int y, int z, int channel, int value){
 		const int index = y*CHUNK_D*CHUNK_W+z*CHUNK_W+x;
-		map[index] = (map[index] & (0xFFFF & (~(0xF << (channel*4))))) | (value << (channel << 2));
+		if (channel == 3)
+			storeS(index, value);
+		else
+			store(index, channel << 2, value);
 	}
 };
 
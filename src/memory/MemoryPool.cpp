@@ -0,0 +1,40 @@
+#include "MemoryPool.h"
+
+#include <stddef.h>
+
+MemoryPool::MemoryPool(size_t blockSize, size_t slabBlocks) : freeList(nullptr), slabBlocks(slabBlocks){
+	const size_t align = alignof(max_align_t);
+	if (blockSize < sizeof(void*))
+		blockSize = sizeof(void*);
+	this->blockSize = (blockSize + align - 1) / align * align;
+}
+
+MemoryPool::~MemoryPool(){
+	for (char* slab : slabs){
+		delete[] slab;
+	}
+}
+
+void* MemoryPool::allocate(){
+	std::lock_guard<std::mutex> lock(mutex);
+	if (freeList == nullptr){
+		char* slab = new char[blockSize * slabBlocks];
+		slabs.push_back(slab);
+		for (size_t i = 0; i < slabBlocks; i++){
+			void* block = slab + i * blockSize;
+			*(void**)block = freeList;
+			freeList = block;
+		}
+	}
+	void* block = freeList;
+	freeList = *(void**)block;
+	return block;
+}
+
+void MemoryPool::release(void* block){
+	if (block == nullptr)
+		return;
+	std::lock_guard<std::mutex> lock(mutex);
+	*(void**)block = freeList;
+	freeList = block;
+}
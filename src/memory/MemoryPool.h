@@ -0,0 +1,24 @@
+#ifndef MEMORY_MEMORYPOOL_H_
+#define MEMORY_MEMORYPOOL_H_
+
+#include <stdlib.h>
+#include <mutex>
+#include <vector>
+
+// Fixed-size blocks carved out of large slabs. Released blocks are kept
+// in a free list and handed out again, slabs are only freed with the pool.
+class MemoryPool {
+	std::mutex mutex;
+	std::vector<char*> slabs;
+	void* freeList;
+	size_t blockSize;
+	size_t slabBlocks;
+public:
+	MemoryPool(size_t blockSize, size_t slabBlocks);
+	~MemoryPool();
+
+	void* allocate();
+	void release(void* block);
+};
+
+#endif /* MEMORY_MEMORYPOOL_H_ */
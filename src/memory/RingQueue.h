@@ -0,0 +1,86 @@
+#ifndef MEMORY_RINGQUEUE_H_
+#define MEMORY_RINGQUEUE_H_
+
+#include <stdlib.h>
+
+// FIFO queue over one power of two sized buffer that is reused between
+// runs. Grows by doubling when full and shrinks back to its reserve only
+// through shrink, so within its working size pushing and popping does not
+// allocate.
+// T is expected to be a plain struct.
+template<typename T>
+class RingQueue {
+	T* buffer;
+	size_t capacity;
+	size_t reserved;
+	size_t head = 0;
+	size_t count = 0;
+	size_t peak = 0;
+
+	void grow(){
+		T* grown = new T[capacity * 2];
+		for (size_t i = 0; i < count; i++)
+			grown[i] = buffer[(head + i) & (capacity - 1)];
+		delete[] buffer;
+		buffer = grown;
+		capacity *= 2;
+		head = 0;
+	}
+public:
+	// capacity is rounded up to a power of two
+	RingQueue(size_t reserve) : capacity(1) {
+		while (capacity < reserve)
+			capacity *= 2;
+		reserved = capacity;
+		buffer = new T[capacity];
+	}
+
+	~RingQueue(){
+		delete[] buffer;
+	}
+
+	RingQueue(const RingQueue&) = delete;
+	RingQueue& operator=(const RingQueue&) = delete;
+
+	inline bool empty() const {
+		return count == 0;
+	}
+
+	inline size_t size() const {
+		return count;
+	}
+
+	// largest number of entries queued at once
+	inline size_t highWater() const {
+		return peak;
+	}
+
+	inline void push(const T& entry){
+		if (count == capacity)
+			grow();
+		buffer[(head + count) & (capacity - 1)] = entry;
+		if (++count > peak)
+			peak = count;
+	}
+
+	// frees the buffer grown past the reserve, only done while empty
+	void shrink(){
+		if (count != 0 || capacity == reserved)
+			return;
+		delete[] buffer;
+		buffer = new T[reserved];
+		capacity = reserved;
+		head = 0;
+	}
+
+	inline const T& front() const {
+		return buffer[head];
+	}
+
+	inline void pop(){
+		head = (head + 1) & (capacity - 1);
+		count--;
+	}
+};
+
+#endif /* MEMORY_RINGQUEUE_H_ */
@@ -0,0 +1,127 @@
+#include "perlin.h"
+
+#include <math.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define NOISE_X86
+#include <immintrin.h>
+#endif
+
+namespace noise_scalar {
+	typedef float vfloat;
+	const int WIDTH = 1;
+
+	static inline vfloat vset(float x){return x;}
+	static inline vfloat vload(const float* src){return *src;}
+	static inline void vstore(float* dest, vfloat x){*dest = x;}
+	static inline vfloat vadd(vfloat a, vfloat b){return a + b;}
+	static inline vfloat vsub(vfloat a, vfloat b){return a - b;}
+	static inline vfloat vmul(vfloat a, vfloat b){return a * b;}
+	static inline vfloat vfloor(vfloat x){return floorf(x);}
+	static inline vfloat vabs(vfloat x){return fabsf(x);}
+	static inline vfloat vstep(vfloat edge, vfloat x){return x < edge ? 0.0f : 1.0f;}
+
+	#include "perlin_kernel.h"
+}
+
+#ifdef NOISE_X86
+#pragma GCC push_options
+#pragma GCC target("sse2")
+namespace noise_sse2 {
+	typedef __m128 vfloat;
+	const int WIDTH = 4;
+
+	static inline vfloat vset(float x){return _mm_set1_ps(x);}
+	static inline vfloat vload(const float* src){return _mm_loadu_ps(src);}
+	static inline void vstore(float* dest, vfloat x){_mm_storeu_ps(dest, x);}
+	static inline vfloat vadd(vfloat a, vfloat b){return _mm_add_ps(a, b);}
+	static inline vfloat vsub(vfloat a, vfloat b){return _mm_sub_ps(a, b);}
+	static inline vfloat vmul(vfloat a, vfloat b){return _mm_mul_ps(a, b);}
+	static inline vfloat vfloor(vfloat x){
+		// truncate, then step down where truncation rounded up (negative values)
+		vfloat t = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+		return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, x), _mm_set1_ps(1.0f)));
+	}
+	static inline vfloat vabs(vfloat x){return _mm_andnot_ps(_mm_set1_ps(-0.0f), x);}
+	static inline vfloat vstep(vfloat edge, vfloat x){
+		return _mm_and_ps(_mm_cmpge_ps(x, edge), _mm_set1_ps(1.0f));
+	}
+
+	#include "perlin_kernel.h"
+}
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+namespace noise_avx2 {
+	typedef __m256 vfloat;
+	const int WIDTH = 8;
+
+	static inline vfloat vset(float x){return _mm256_set1_ps(x);}
+	static inline vfloat vload(const float* src){return _mm256_loadu_ps(src);}
+	static inline void vstore(float* dest, vfloat x){_mm256_storeu_ps(dest, x);}
+	static inline vfloat vadd(vfloat a, vfloat b){return _mm256_add_ps(a, b);}
+	static inline vfloat vsub(vfloat a, vfloat b){return _mm256_sub_ps(a, b);}
+	static inline vfloat vmul(vfloat a, vfloat b){return _mm256_mul_ps(a, b);}
+	static inline vfloat vfloor(vfloat x){return _mm256_floor_ps(x);}
+	static inline vfloat vabs(vfloat x){return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), x);}
+	static inline vfloat vstep(vfloat edge, vfloat x){
+		return _mm256_and_ps(_mm256_cmp_ps(x, edge, _CMP_GE_OQ), _mm256_set1_ps(1.0f));
+	}
+
+	#include "perlin_kernel.h"
+}
+#pragma GCC pop_options
+#endif
+
+typedef void (*perlin_row_func)(float*, int, float, float, int, float);
+
+// nullptr if the CPU can't run kernel
+static perlin_row_func get_row_func(PerlinKernel kernel){
+	switch (kernel){
+#ifdef NOISE_X86
+	case PERLIN_AVX2:
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2") ? noise_avx2::perlin_row : nullptr;
+	case PERLIN_SSE2:
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("sse2") ? noise_sse2::perlin_row : nullptr;
+#endif
+	case PERLIN_SCALAR:
+		return noise_scalar::perlin_row;
+	default:
+		return nullptr;
+	}
+}
+
+// picked once, on the first call, from the instruction sets the CPU reports
+static perlin_row_func select_row_func(){
+	if (perlin_row_func row = get_row_func(PERLIN_AVX2))
+		return row;
+	if (perlin_row_func row = get_row_func(PERLIN_SSE2))
+		return row;
+	return noise_scalar::perlin_row;
+}
+
+static void grid(perlin_row_func row, float* dest, int ox, int oy, int oz, int w, int h, int d, float scale){
+	for (int y = 0; y < h; y++){
+		float fy = (float)(oy + y) * scale;
+		for (int z = 0; z < d; z++){
+			float fz = (float)(oz + z) * scale;
+			row(dest + (y * d + z) * w, ox, fy, fz, w, scale);
+		}
+	}
+}
+
+void perlin_grid(float* dest, int ox, int oy, int oz, int w, int h, int d, float scale){
+	static const perlin_row_func row = select_row_func();
+	grid(row, dest, ox, oy, oz, w, h, d, scale);
+}
+
+bool perlin_grid_kernel(PerlinKernel kernel, float* dest, int ox, int oy, int oz, int w, int h, int d, float scale){
+	perlin_row_func row = get_row_func(kernel);
+	if (row == nullptr)
+		return false;
+	grid(row, dest, ox, oy, oz, w, h, d, scale);
+	return true;
+}
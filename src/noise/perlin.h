@@ -0,0 +1,18 @@
+#ifndef NOISE_PERLIN_H_
+#define NOISE_PERLIN_H_
+
+// Fills dest[(y * d + z) * w + x] with glm::perlin(vec3(ox+x, oy+y, oz+z) * scale)
+// for a w*h*d grid. Uses AVX2 or SSE2 when the CPU supports them.
+extern void perlin_grid(float* dest, int ox, int oy, int oz, int w, int h, int d, float scale);
+
+enum PerlinKernel {
+	PERLIN_SCALAR,
+	PERLIN_SSE2,
+	PERLIN_AVX2
+};
+
+// perlin_grid computed with the given kernel, for comparing them (see perlin_bench.cpp);
+// returns false and leaves dest as is if the CPU can't run it
+extern bool perlin_grid_kernel(PerlinKernel kernel, float* dest, int ox, int oy, int oz, int w, int h, int d, float scale);
+
+#endif /* NOISE_PERLIN_H_ */
@@ -0,0 +1,99 @@
+// Checks the perlin_grid kernels against glm::perlin and times them. Not part
+// of the engine, built on its own with:
+//   g++ -O2 -DPERLIN_BENCH src/noise/perlin.cpp src/noise/perlin_bench.cpp -o perlin_bench
+// exits with 1 if a kernel differs from glm::perlin by more than PERLIN_TOLERANCE.
+#ifdef PERLIN_BENCH
+
+#include "perlin.h"
+
+#include <stdio.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/noise.hpp>
+
+// the kernels keep glm's operation order, so they are expected to match exactly
+#define PERLIN_TOLERANCE 0.0f
+
+struct gridcase {
+	int ox, oy, oz;
+	int w, h, d;
+	float scale;
+};
+
+// the grids of WorldGenerator, negative origins and a width that is no multiple of 8
+static const gridcase cases[] = {
+	{-4096, 512, 0, 16, 16, 1, 0.0026125f},
+	{-4096, 512, 0, 16, 16, 1, 0.006125f},
+	{-32, 0, 48, 16, 17, 16, 0.0125f},
+	{1000, -77, -3000, 35, 9, 11, 0.037f},
+};
+
+int main(){
+	const char* names[] = {"scalar", "sse2", "avx2"};
+	const PerlinKernel kernels[] = {PERLIN_SCALAR, PERLIN_SSE2, PERLIN_AVX2};
+	int failed = 0;
+
+	for (const gridcase& c : cases){
+		const size_t size = c.w * c.h * c.d;
+		std::vector<float> expected(size);
+		for (int y = 0; y < c.h; y++){
+			for (int z = 0; z < c.d; z++){
+				for (int x = 0; x < c.w; x++){
+					glm::vec3 pos(c.ox + x, c.oy + y, c.oz + z);
+					expected[(y * c.d + z) * c.w + x] = glm::perlin(pos * c.scale);
+				}
+			}
+		}
+		for (int k = 0; k < 3; k++){
+			std::vector<float> values(size);
+			if (!perlin_grid_kernel(kernels[k], values.data(), c.ox, c.oy, c.oz, c.w, c.h, c.d, c.scale))
+				continue;
+			float error = 0.0f;
+			for (size_t i = 0; i < size; i++)
+				error = fmaxf(error, fabsf(values[i] - expected[i]));
+			if (error > PERLIN_TOLERANCE){
+				printf("%s: %dx%dx%d grid at %d,%d,%d differs by %g\n", names[k], c.w, c.h, c.d, c.ox, c.oy, c.oz, error);
+				failed = 1;
+			}
+		}
+	}
+
+	// one chunk of WorldGenerator::generate, repeated
+	const int runs = 500;
+	std::vector<float> values(16 * 17 * 16);
+	// keeps the timed loops from being optimized out
+	volatile float sink = 0.0f;
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < runs; i++){
+		for (int y = 0; y < 17; y++){
+			for (int z = 0; z < 16; z++){
+				for (int x = 0; x < 16; x++){
+					glm::vec3 pos(i * 16 + x, y, z);
+					values[(y * 16 + z) * 16 + x] = glm::perlin(pos * 0.0125f);
+				}
+			}
+		}
+		sink += values[i % values.size()];
+	}
+	double base = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	printf("glm::perlin: %.2f ms\n", base);
+	for (int k = 0; k < 3; k++){
+		start = std::chrono::steady_clock::now();
+		bool supported = true;
+		for (int i = 0; i < runs && supported; i++){
+			supported = perlin_grid_kernel(kernels[k], values.data(), i * 16, 0, 0, 16, 17, 16, 0.0125f);
+			sink += values[i % values.size()];
+		}
+		if (!supported){
+			printf("%s: not supported\n", names[k]);
+			continue;
+		}
+		double time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		printf("%s: %.2f ms (x%.1f)\n", names[k], time, base / time);
+	}
+	return failed;
+}
+
+#endif /* PERLIN_BENCH */
@@ -0,0 +1,103 @@
+// Classic 3D gradient noise of glm::perlin computed for WIDTH points at once.
+// Included by perlin.cpp once per instruction set, after defining vfloat,
+// WIDTH and the v* operations in the including namespace.
+
+static inline vfloat vmod289(vfloat x){
+	return vsub(x, vmul(vfloor(vmul(x, vset(1.0f / 289.0f))), vset(289.0f)));
+}
+
+static inline vfloat vpermute(vfloat x){
+	return vmod289(vmul(vadd(vmul(x, vset(34.0f)), vset(1.0f)), x));
+}
+
+static inline vfloat vfract(vfloat x){
+	return vsub(x, vfloor(x));
+}
+
+static inline vfloat vfade(vfloat t){
+	return vmul(vmul(vmul(t, t), t), vadd(vmul(t, vsub(vmul(t, vset(6.0f)), vset(15.0f))), vset(10.0f)));
+}
+
+static inline vfloat vmix(vfloat x, vfloat y, vfloat a){
+	return vadd(vmul(x, vsub(vset(1.0f), a)), vmul(y, a));
+}
+
+// dot product of the normalized corner gradient picked by hash with (fx, fy, fz)
+static inline vfloat vgradient(vfloat hash, vfloat fx, vfloat fy, vfloat fz){
+	vfloat gx = vmul(hash, vset(1.0f / 7.0f));
+	vfloat gy = vsub(vfract(vmul(vfloor(gx), vset(1.0f / 7.0f))), vset(0.5f));
+	gx = vfract(gx);
+	vfloat gz = vsub(vsub(vset(0.5f), vabs(gx)), vabs(gy));
+	vfloat sz = vstep(gz, vset(0.0f));
+	gx = vsub(gx, vmul(sz, vsub(vstep(vset(0.0f), gx), vset(0.5f))));
+	gy = vsub(gy, vmul(sz, vsub(vstep(vset(0.0f), gy), vset(0.5f))));
+
+	vfloat norm = vsub(vset(1.79284291400159f), vmul(vset(0.85373472095314f),
+			vadd(vadd(vmul(gx, gx), vmul(gy, gy)), vmul(gz, gz))));
+	return vadd(vadd(vmul(vmul(gx, norm), fx), vmul(vmul(gy, norm), fy)), vmul(vmul(gz, norm), fz));
+}
+
+static inline vfloat vperlin(vfloat x, vfloat y, vfloat z){
+	vfloat pi0x = vfloor(x);
+	vfloat pi0y = vfloor(y);
+	vfloat pi0z = vfloor(z);
+	vfloat pi1x = vmod289(vadd(pi0x, vset(1.0f)));
+	vfloat pi1y = vmod289(vadd(pi0y, vset(1.0f)));
+	vfloat pi1z = vmod289(vadd(pi0z, vset(1.0f)));
+	pi0x = vmod289(pi0x);
+	pi0y = vmod289(pi0y);
+	pi0z = vmod289(pi0z);
+
+	vfloat pf0x = vfract(x);
+	vfloat pf0y = vfract(y);
+	vfloat pf0z = vfract(z);
+	vfloat pf1x = vsub(pf0x, vset(1.0f));
+	vfloat pf1y = vsub(pf0y, vset(1.0f));
+	vfloat pf1z = vsub(pf0z, vset(1.0f));
+
+	vfloat px0 = vpermute(pi0x);
+	vfloat px1 = vpermute(pi1x);
+	vfloat ixy00 = vpermute(vadd(px0, pi0y));
+	vfloat ixy10 = vpermute(vadd(px1, pi0y));
+	vfloat ixy01 = vpermute(vadd(px0, pi1y));
+	vfloat ixy11 = vpermute(vadd(px1, pi1y));
+
+	vfloat n000 = vgradient(vpermute(vadd(ixy00, pi0z)), pf0x, pf0y, pf0z);
+	vfloat n100 = vgradient(vpermute(vadd(ixy10, pi0z)), pf1x, pf0y, pf0z);
+	vfloat n010 = vgradient(vpermute(vadd(ixy01, pi0z)), pf0x, pf1y, pf0z);
+	vfloat n110 = vgradient(vpermute(vadd(ixy11, pi0z)), pf1x, pf1y, pf0z);
+	vfloat n001 = vgradient(vpermute(vadd(ixy00, pi1z)), pf0x, pf0y, pf1z);
+	vfloat n101 = vgradient(vpermute(vadd(ixy10, pi1z)), pf1x, pf0y, pf1z);
+	vfloat n011 = vgradient(vpermute(vadd(ixy01, pi1z)), pf0x, pf1y, pf1z);
+	vfloat n111 = vgradient(vpermute(vadd(ixy11, pi1z)), pf1x, pf1y, pf1z);
+
+	vfloat fx = vfade(pf0x);
+	vfloat fy = vfade(pf0y);
+	vfloat fz = vfade(pf0z);
+	vfloat nz00 = vmix(n000, n001, fz);
+	vfloat nz10 = vmix(n100, n101, fz);
+	vfloat nz01 = vmix(n010, n011, fz);
+	vfloat nz11 = vmix(n110, n111, fz);
+	vfloat ny0 = vmix(nz00, nz01, fy);
+	vfloat ny1 = vmix(nz10, nz11, fy);
+	return vmul(vset(2.2f), vmix(ny0, ny1, fx));
+}
+
+static void perlin_row(float* dest, int ox, float y, float z, int w, float scale){
+	vfloat vy = vset(y);
+	vfloat vz = vset(z);
+	int x = 0;
+	for (; x + WIDTH <= w; x += WIDTH){
+		float xs[WIDTH];
+		for (int i = 0; i < WIDTH; i++)
+			xs[i] = (float)(ox + x + i) * scale;
+		vstore(dest + x, vperlin(vload(xs), vy, vz));
+	}
+	for (; x < w; x++){
+		float xs[WIDTH] = {};
+		float out[WIDTH];
+		xs[0] = (float)(ox + x) * scale;
+		vstore(out, vperlin(vload(xs), vy, vz));
+		dest[x] = out[0];
+	}
+}
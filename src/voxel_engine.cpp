@@ -14,6 +14,7 @@ using namespace glm;
 #include "graphics/Shader.h"
 #include "graphics/Texture.h"
 #include "graphics/Mesh.h"
+#include "graphics/MeshPool.h"
 #include "graphics/VoxelRenderer.h"
 #include "graphics/LineBatch.h"
 #include "window/Window.h"
@@ -23,6 +24,9 @@ using namespace glm;
 #include "voxels/voxel.h"
 #include "voxels/Chunk.h"
 #include "voxels/Chunks.h"
+#include "voxels/ChunksController.h"
+#include "voxels/WorldGenerator.h"
+#include "jobs/WorkerPool.h"
 #include "voxels/Block.h"
 #include "files/files.h"
 #include "lighting/LightSolver.h"
@@ -32,6 +36,12 @@ using namespace glm;
 int WIDTH = 1280;
 int HEIGHT = 720;
 
+// light entries solved per frame for each kind of light, seeding included
+#define LIGHT_FRAME_BUDGET 32768
+// columns out of range wait for the light in flight to be unloaded, up to this
+// many columns beyond the unload radius
+#define UNLOAD_MARGIN 2
+
 float vertices[] = {
 		// x    y
 	   -0.01f,-0.01f,
@@ -112,15 +122,17 @@ int main() {
 		block = new Block(5,6);
 		Block::blocks[block->id] = block;
 	}
+	Block::updateTables();
 
-	Chunks* chunks = new Chunks(16,16,16);
-	Mesh** meshes = new Mesh*[chunks->volume];
-	for (size_t i = 0; i < chunks->volume; i++)
-		meshes[i] = nullptr;
+	WorkerPool* workers = new WorkerPool(0);
+	Chunks* chunks = new Chunks(16);
+	WorldGenerator* generator = new WorldGenerator();
+	ChunksController* chunksController = new ChunksController(chunks, workers, generator, 8, 10);
 	VoxelRenderer renderer(1024*1024*8);
 	LineBatch* lineBatch = new LineBatch(4096);
 
-	Lighting::initialize(chunks);
+	Lighting::initialize(chunks, workers);
+	Lighting::setBudgeted(true);
 
 	glClearColor(0.0f,0.0f,0.0f,1);
 
@@ -142,7 +154,12 @@ int main() {
 
 	int choosenBlock = 1;
 
+	chunksController->update(camera->position);
 	Lighting::onWorldLoaded();
+	Lighting::finish();
+	int columnX = floor(camera->position.x / CHUNK_W);
+	int columnZ = floor(camera->position.z / CHUNK_D);
+	bool unloading = false;
 
 	while (!Window::isShouldClose()){
 		float currentTime = glfwGetTime();
@@ -162,20 +179,24 @@ int main() {
 			}
 		}
 		if (Events::jpressed(GLFW_KEY_F1)){
-			unsigned char* buffer = new unsigned char[chunks->volume * CHUNK_VOL];
-			chunks->write(buffer);
-			write_binary_file("world.bin", (const char*)buffer, chunks->volume * CHUNK_VOL);
+			unsigned char* buffer = new unsigned char[chunks->chunks.size() * (sizeof(int32_t) * 3 + CHUNK_VOL)];
+			size_t size = chunks->write(buffer);
+			write_binary_file("world.bin", (const char*)buffer, size);
 			delete[] buffer;
-			std::cout << "world saved in " << (chunks->volume * CHUNK_VOL) << " bytes" << std::endl;
+			std::cout << "world saved in " << size << " bytes" << std::endl;
 		}
 		if (Events::jpressed(GLFW_KEY_F2)){
-			unsigned char* buffer = new unsigned char[chunks->volume * CHUNK_VOL];
-			read_binary_file("world.bin", (char*)buffer, chunks->volume * CHUNK_VOL);
-			chunks->read(buffer);
-			delete[] buffer;
-
-			Lighting::clear();
-			Lighting::onWorldLoaded();
+			size_t size;
+			char* buffer = read_binary_file("world.bin", size);
+			if (buffer != nullptr){
+				// light in flight was seeded from the voxels being replaced
+				Lighting::finish();
+				std::vector<Chunk*> changed;
+				chunks->read((const unsigned char*)buffer, size, changed);
+				delete[] buffer;
+
+				Lighting::onChunksChanged(changed);
+			}
 		}
 
 		if (Events::pressed(GLFW_KEY_W)){
@@ -206,12 +227,26 @@ int main() {
 			camera->rotate(camY, camX, 0);
 		}
 
+		// chunks are loaded when the camera enters another column and unloaded once
+		// no light work in flight refers to them, unless they got too far to wait
+		if (columnX != (int)floor(camera->position.x / CHUNK_W) || columnZ != (int)floor(camera->position.z / CHUNK_D)){
+			columnX = floor(camera->position.x / CHUNK_W);
+			columnZ = floor(camera->position.z / CHUNK_D);
+			if (chunksController->unloads(camera->position, UNLOAD_MARGIN)){
+				Lighting::finish();
+				chunksController->unload(camera->position);
+			}
+			if (chunksController->load(camera->position)){
+				Lighting::onChunksLoaded(chunksController->loaded);
+			}
+			unloading = true;
+		}
+
 		{
 			vec3 end;
 			vec3 norm;
 			vec3 iend;
-			voxel* vox = chunks->rayCast(camera->position, camera->front, 10.0f, end, norm, iend);
-			if (vox != nullptr){
+			if (chunks->rayCast(camera->position, camera->front, 10.0f, end, norm, iend)){
 				lineBatch->box(iend.x+0.5f, iend.y+0.5f, iend.z+0.5f, 1.005f,1.005f,1.005f, 0,0,0,0.5f);
 
 				if (Events::jclicked(GLFW_MOUSE_BUTTON_1)){
@@ -219,47 +254,28 @@ int main() {
 					int y = (int)iend.y;
 					int z = (int)iend.z;
 					chunks->set(x,y,z, 0);
-					Lighting::onBlockSet(x,y,z,0);
+					Lighting::onBlockSet(x,y,z);
 				}
 				if (Events::jclicked(GLFW_MOUSE_BUTTON_2)){
 					int x = (int)(iend.x)+(int)(norm.x);
 					int y = (int)(iend.y)+(int)(norm.y);
 					int z = (int)(iend.z)+(int)(norm.z);
 					chunks->set(x, y, z, choosenBlock);
-					Lighting::onBlockSet(x,y,z, choosenBlock);
+					Lighting::onBlockSet(x,y,z);
 				}
 			}
 		}
 
-		Chunk* closes[27];
-		for (size_t i = 0; i < chunks->volume; i++){
-			Chunk* chunk = chunks->chunks[i];
-			if (!chunk->modified)
+		if (Lighting::update(LIGHT_FRAME_BUDGET) && unloading){
+			chunksController->unload(camera->position);
+			unloading = false;
+		}
+		for (Chunk* chunk : chunks->dirty){
+			if (chunk->dirty & DIRTY_PENDING)
 				continue;
-			chunk->modified = false;
-			if (meshes[i] != nullptr)
-				delete meshes[i];
-
-			for (int i = 0; i < 27; i++)
-				closes[i] = nullptr;
-			for (size_t j = 0; j < chunks->volume; j++){
-				Chunk* other = chunks->chunks[j];
-
-				int ox = other->x - chunk->x;
-				int oy = other->y - chunk->y;
-				int oz = other->z - chunk->z;
-
-				if (abs(ox) > 1 || abs(oy) > 1 || abs(oz) > 1)
-					continue;
-
-				ox += 1;
-				oy += 1;
-				oz += 1;
-				closes[(oy * 3 + oz) * 3 + ox] = other;
-			}
-			Mesh* mesh = renderer.render(chunk, (const Chunk**)closes);
-			meshes[i] = mesh;
+			chunk->mesh = renderer.render(chunk, (const Chunk**)chunk->neighbours);
 		}
+		chunks->clearDirty();
 
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -268,9 +284,11 @@ int main() {
 		shader->uniformMatrix("projview", camera->getProjection()*camera->getView());
 		texture->bind();
 		mat4 model(1.0f);
-		for (size_t i = 0; i < chunks->volume; i++){
-			Chunk* chunk = chunks->chunks[i];
-			Mesh* mesh = meshes[i];
+		for (auto& entry : chunks->chunks){
+			Chunk* chunk = entry.second;
+			Mesh* mesh = chunk->mesh;
+			if (mesh == nullptr)
+				continue;
 			model = glm::translate(mat4(1.0f), vec3(chunk->x*CHUNK_W+0.5f, chunk->y*CHUNK_H+0.5f, chunk->z*CHUNK_D+0.5f));
 			shader->uniformMatrix("model", model);
 			mesh->draw(GL_TRIANGLES);
@@ -288,11 +306,16 @@ int main() {
 		Events::pullEvents();
 	}
 
+	std::cout << "light queues high-water mark: " << Lighting::queuesHighWater() << " entries" << std::endl;
 	Lighting::finalize();
 
 	delete shader;
 	delete texture;
+	delete chunksController;
 	delete chunks;
+	delete generator;
+	delete workers;
+	MeshPool::finalize();
 	delete crosshair;
 	delete crosshairShader;
 	delete linesShader;
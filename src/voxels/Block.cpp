@@ -2,7 +2,31 @@
 
 Block* Block::blocks[256];
 
+unsigned char Block::drawGroupTable[256];
+bool Block::lightPassingTable[256];
+unsigned short Block::emissionTable[256];
+int Block::textureFacesTable[256][6];
+
 Block::Block(unsigned int id, int texture) : id(id),
 		textureFaces{texture,texture,texture,texture,texture,texture},
 		emission{0,0,0}{
 }
+
+void Block::updateTables(){
+	for (int id = 0; id < 256; id++){
+		Block* block = blocks[id];
+		if (block == nullptr){
+			drawGroupTable[id] = 0;
+			lightPassingTable[id] = false;
+			emissionTable[id] = 0;
+			for (int i = 0; i < 6; i++)
+				textureFacesTable[id][i] = 0;
+			continue;
+		}
+		drawGroupTable[id] = block->drawGroup;
+		lightPassingTable[id] = block->lightPassing;
+		emissionTable[id] = block->emission[0] | (block->emission[1] << 4) | (block->emission[2] << 8);
+		for (int i = 0; i < 6; i++)
+			textureFacesTable[id][i] = block->textureFaces[i];
+	}
+}
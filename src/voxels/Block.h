@@ -5,6 +5,16 @@ class Block {
 public:
 	static Block* blocks[256];
 
+	// properties of blocks[id] in flat tables for the inner loops,
+	// filled by updateTables after the blocks are registered
+	static unsigned char drawGroupTable[256];
+	static bool lightPassingTable[256];
+	// emission packed as in lightmaps: r | g << 4 | b << 8
+	static unsigned short emissionTable[256];
+	static int textureFacesTable[256][6];
+
+	static void updateTables();
+
 	const unsigned int id;
 						 //  0 1   2 3   4 5
 	int textureFaces[6]; // -x,x, -y,y, -z,z
@@ -1,22 +1,64 @@
 #ifndef VOXELS_CHUNK_H_
 #define VOXELS_CHUNK_H_
 
+#include <stdlib.h>
+#include <stdint.h>
+
 #define CHUNK_W 16
 #define CHUNK_H 16
 #define CHUNK_D 16
 #define CHUNK_VOL (CHUNK_W * CHUNK_H * CHUNK_D)
 
-class voxel;
+// a / b rounded down for b > 0, e.g. chunk coordinate of a voxel coordinate
+static inline int floordiv(int a, int b){
+	return (a < 0) ? ((a + 1) / b - 1) : (a / b);
+}
+
+// reasons for a chunk to be in the dirty queue of Chunks
+#define DIRTY_VOXELS 0x1
+#define DIRTY_LIGHT 0x2
+// light of the chunk is still being solved, it stays queued but is not remeshed
+#define DIRTY_PENDING 0x4
+
+class VoxelPalette;
 class Lightmap;
+class VoxelMasks;
+class Mesh;
 
-class Chunk {
+class Chunk final {
 public:
 	int x,y,z;
-	voxel* voxels;
+	VoxelPalette* voxels;
 	Lightmap* lightmap;
-	bool modified = true;
+	// kept in sync with voxels by Chunks and WorldGenerator
+	VoxelMasks* masks;
+	Mesh* mesh = nullptr;
+	// loaded chunks around this one (and itself in the middle),
+	// indexed by ((dy+1) * 3 + dz+1) * 3 + dx+1
+	Chunk* neighbours[27];
+	unsigned char dirty = 0;
+	// index in Chunks::slots while the chunk is put
+	uint32_t slot = 0;
+
+	// chunk containing local coordinates that are at most one chunk outside
+	// of this one, the coordinates are made local to it; nullptr if not loaded
+	inline Chunk* locate(int& lx, int& ly, int& lz) const {
+		const int dx = lx < 0 ? -1 : (lx >= CHUNK_W ? 1 : 0);
+		const int dy = ly < 0 ? -1 : (ly >= CHUNK_H ? 1 : 0);
+		const int dz = lz < 0 ? -1 : (lz >= CHUNK_D ? 1 : 0);
+		lx -= dx * CHUNK_W;
+		ly -= dy * CHUNK_H;
+		lz -= dz * CHUNK_D;
+		return neighbours[((dy+1) * 3 + dz+1) * 3 + dx+1];
+	}
+
+	// starts filled with air, see WorldGenerator
 	Chunk(int x, int y, int z);
 	~Chunk();
+
+	// objects come from a pool of sizeof(Chunk), the class is final for that
+	static void* operator new(size_t);
+	static void operator delete(void* ptr);
 };
 
 #endif /* VOXELS_CHUNK_H_ */
@@ -1,7 +1,10 @@
 #include "Chunks.h"
 #include "Chunk.h"
 #include "voxel.h"
+#include "VoxelPalette.h"
+#include "VoxelMasks.h"
 #include "../lighting/Lightmap.h"
+#include "../jobs/WorkerPool.h"
 
 #include <glm/glm.hpp>
 
@@ -9,112 +12,290 @@ using namespace glm;
 
 #include <math.h>
 #include <limits.h>
+#include <string.h>
+#include <algorithm>
 
-Chunks::Chunks(int w, int h, int d) : w(w), h(h), d(d){
-	volume = w*h*d;
-	chunks = new Chunk*[volume];
+Chunks::Chunks(int h) : h(h){
+}
+
+Chunks::~Chunks(){
+	for (auto& entry : chunks){
+		delete entry.second;
+	}
+}
 
-	int index = 0;
-	for (int y = 0; y < h; y++){
-		for (int z = 0; z < d; z++){
-			for (int x = 0; x < w; x++, index++){
-				Chunk* chunk = new Chunk(x,y,z);
-				chunks[index] = chunk;
+void Chunks::put(Chunk* chunk){
+	chunks[key(chunk->x, chunk->y, chunk->z)] = chunk;
+	if (freeSlots.empty()){
+		chunk->slot = slots.size();
+		slots.push_back(chunk);
+	} else {
+		chunk->slot = freeSlots.back();
+		freeSlots.pop_back();
+		slots[chunk->slot] = chunk;
+	}
+	markDirty(chunk, DIRTY_VOXELS);
+	for (int y = -1; y <= 1; y++){
+		for (int z = -1; z <= 1; z++){
+			for (int x = -1; x <= 1; x++){
+				if (x == 0 && y == 0 && z == 0)
+					continue;
+				Chunk* other = getChunk(chunk->x+x, chunk->y+y, chunk->z+z);
+				chunk->neighbours[((y+1) * 3 + z+1) * 3 + x+1] = other;
+				if (other){
+					other->neighbours[((1-y) * 3 + 1-z) * 3 + 1-x] = chunk;
+					markDirty(other, DIRTY_VOXELS);
+				}
 			}
 		}
 	}
 }
 
-Chunks::~Chunks(){
-	for (size_t i = 0; i < volume; i++){
-		delete chunks[i];
+void Chunks::remove(int x, int y, int z){
+	auto found = chunks.find(key(x, y, z));
+	if (found == chunks.end())
+		return;
+	Chunk* chunk = found->second;
+	chunks.erase(found);
+	slots[chunk->slot] = nullptr;
+	freeSlots.push_back(chunk->slot);
+	if (chunk->dirty)
+		dirty.erase(std::find(dirty.begin(), dirty.end(), chunk));
+	for (int i = 0; i < 27; i++){
+		Chunk* other = chunk->neighbours[i];
+		if (other == nullptr || other == chunk)
+			continue;
+		other->neighbours[26-i] = nullptr;
+		markDirty(other, DIRTY_VOXELS);
 	}
-	delete[] chunks;
+	delete chunk;
 }
 
-voxel* Chunks::get(int x, int y, int z){
-	int cx = x / CHUNK_W;
-	int cy = y / CHUNK_H;
-	int cz = z / CHUNK_D;
-	if (x < 0) cx--;
-	if (y < 0) cy--;
-	if (z < 0) cz--;
-	if (cx < 0 || cy < 0 || cz < 0 || cx >= w || cy >= h || cz >= d)
-		return nullptr;
-	Chunk* chunk = chunks[(cy * d + cz) * w + cx];
-	int lx = x - cx * CHUNK_W;
-	int ly = y - cy * CHUNK_H;
-	int lz = z - cz * CHUNK_D;
-	return &chunk->voxels[(ly * CHUNK_D + lz) * CHUNK_W + lx];
+void Chunks::clearDirty(){
+	size_t kept = 0;
+	for (Chunk* chunk : dirty){
+		if (chunk->dirty & DIRTY_PENDING){
+			dirty[kept++] = chunk;
+			continue;
+		}
+		chunk->dirty = 0;
+	}
+	dirty.resize(kept);
+}
+
+voxel Chunks::get(int x, int y, int z){
+	Chunk* chunk = getChunkByVoxel(x, y, z);
+	if (chunk == nullptr)
+		return voxel {0};
+	int lx = x - chunk->x * CHUNK_W;
+	int ly = y - chunk->y * CHUNK_H;
+	int lz = z - chunk->z * CHUNK_D;
+	return chunk->voxels->get((ly * CHUNK_D + lz) * CHUNK_W + lx);
 }
 
 unsigned char Chunks::getLight(int x, int y, int z, int channel){
-	int cx = x / CHUNK_W;
-	int cy = y / CHUNK_H;
-	int cz = z / CHUNK_D;
-	if (x < 0) cx--;
-	if (y < 0) cy--;
-	if (z < 0) cz--;
-	if (cx < 0 || cy < 0 || cz < 0 || cx >= w || cy >= h || cz >= d)
+	Chunk* chunk = getChunkByVoxel(x, y, z);
+	if (chunk == nullptr)
 		return 0;
-	Chunk* chunk = chunks[(cy * d + cz) * w + cx];
-	int lx = x - cx * CHUNK_W;
-	int ly = y - cy * CHUNK_H;
-	int lz = z - cz * CHUNK_D;
+	int lx = x - chunk->x * CHUNK_W;
+	int ly = y - chunk->y * CHUNK_H;
+	int lz = z - chunk->z * CHUNK_D;
 	return chunk->lightmap->get(lx,ly,lz, channel);
 }
 
 Chunk* Chunks::getChunkByVoxel(int x, int y, int z){
-	int cx = x / CHUNK_W;
-	int cy = y / CHUNK_H;
-	int cz = z / CHUNK_D;
-	if (x < 0) cx--;
-	if (y < 0) cy--;
-	if (z < 0) cz--;
-	if (cx < 0 || cy < 0 || cz < 0 || cx >= w || cy >= h || cz >= d)
-		return nullptr;
-	return chunks[(cy * d + cz) * w + cx];
+	return getChunk(floordiv(x, CHUNK_W), floordiv(y, CHUNK_H), floordiv(z, CHUNK_D));
 }
 
 Chunk* Chunks::getChunk(int x, int y, int z){
-	if (x < 0 || y < 0 || z < 0 || x >= w || y >= h || z >= d)
+	if (y < 0 || y >= (int)h)
+		return nullptr;
+	auto found = chunks.find(key(x, y, z));
+	if (found == chunks.end())
 		return nullptr;
-	return chunks[(y * d + z) * w + x];
+	return found->second;
+}
+
+int Chunks::getHeight(int x, int y, int z){
+	const int top = h * CHUNK_H;
+	if (y > top)
+		y = top;
+	if (y <= 0)
+		return 0;
+	const int cy = (y-1) / CHUNK_H;
+	Chunk* chunk = getChunk(floordiv(x, CHUNK_W), cy, floordiv(z, CHUNK_D));
+	if (chunk == nullptr)
+		return 0;
+	const int lx = x - chunk->x * CHUNK_W;
+	const int lz = z - chunk->z * CHUNK_D;
+	int height = chunk->masks->height(lx, y - cy * CHUNK_H, lz);
+	// chunks further down only need their column heights
+	while (height == 0){
+		chunk = chunk->neighbours[4]; // dy = -1
+		if (chunk == nullptr)
+			return 0;
+		height = chunk->masks->heights[lz * CHUNK_W + lx];
+	}
+	return chunk->y * CHUNK_H + height;
 }
 
 void Chunks::set(int x, int y, int z, int id){
-	int cx = x / CHUNK_W;
-	int cy = y / CHUNK_H;
-	int cz = z / CHUNK_D;
-	if (x < 0) cx--;
-	if (y < 0) cy--;
-	if (z < 0) cz--;
-	if (cx < 0 || cy < 0 || cz < 0 || cx >= w || cy >= h || cz >= d)
+	Chunk* chunk = getChunkByVoxel(x, y, z);
+	if (chunk == nullptr)
 		return;
-	Chunk* chunk = chunks[(cy * d + cz) * w + cx];
+	int cx = chunk->x;
+	int cy = chunk->y;
+	int cz = chunk->z;
 	int lx = x - cx * CHUNK_W;
 	int ly = y - cy * CHUNK_H;
 	int lz = z - cz * CHUNK_D;
-	chunk->voxels[(ly * CHUNK_D + lz) * CHUNK_W + lx].id = id;
-	chunk->modified = true;
+	const unsigned int index = (ly * CHUNK_D + lz) * CHUNK_W + lx;
+	chunk->voxels->set(index, id);
+	chunk->masks->set(index, id);
+	markDirty(chunk, DIRTY_VOXELS);
+
+	if (lx == 0 && (chunk = getChunk(cx-1, cy, cz))) markDirty(chunk, DIRTY_VOXELS);
+	if (ly == 0 && (chunk = getChunk(cx, cy-1, cz))) markDirty(chunk, DIRTY_VOXELS);
+	if (lz == 0 && (chunk = getChunk(cx, cy, cz-1))) markDirty(chunk, DIRTY_VOXELS);
+
+	if (lx == CHUNK_W-1 && (chunk = getChunk(cx+1, cy, cz))) markDirty(chunk, DIRTY_VOXELS);
+	if (ly == CHUNK_H-1 && (chunk = getChunk(cx, cy+1, cz))) markDirty(chunk, DIRTY_VOXELS);
+	if (lz == CHUNK_D-1 && (chunk = getChunk(cx, cy, cz+1))) markDirty(chunk, DIRTY_VOXELS);
+}
+
+// Calls func(chunk, index, x, y, z) for every voxel of loaded chunks in the region,
+// then rebuilds the masks of the visited chunks and marks them and the
+// neighbours next to the region dirty
+template<typename F>
+static void editRegion(Chunks* chunks, int x1, int y1, int z1, int x2, int y2, int z2, F func){
+	if (x1 >= x2 || y1 >= y2 || z1 >= z2)
+		return;
+	const int cx1 = floordiv(x1, CHUNK_W), cx2 = floordiv(x2-1, CHUNK_W);
+	const int cy1 = floordiv(y1, CHUNK_H), cy2 = floordiv(y2-1, CHUNK_H);
+	const int cz1 = floordiv(z1, CHUNK_D), cz2 = floordiv(z2-1, CHUNK_D);
+	for (int cy = cy1; cy <= cy2; cy++){
+		for (int cz = cz1; cz <= cz2; cz++){
+			for (int cx = cx1; cx <= cx2; cx++){
+				Chunk* chunk = chunks->getChunk(cx, cy, cz);
+				if (chunk == nullptr)
+					continue;
+				const int bx = cx * CHUNK_W, by = cy * CHUNK_H, bz = cz * CHUNK_D;
+				const int lx1 = std::max(x1 - bx, 0), lx2 = std::min(x2 - bx, CHUNK_W);
+				const int ly1 = std::max(y1 - by, 0), ly2 = std::min(y2 - by, CHUNK_H);
+				const int lz1 = std::max(z1 - bz, 0), lz2 = std::min(z2 - bz, CHUNK_D);
+				for (int ly = ly1; ly < ly2; ly++){
+					for (int lz = lz1; lz < lz2; lz++){
+						for (int lx = lx1; lx < lx2; lx++){
+							func(chunk, (ly * CHUNK_D + lz) * CHUNK_W + lx, bx + lx, by + ly, bz + lz);
+						}
+					}
+				}
+				chunk->masks->build(chunk->voxels);
+			}
+		}
+	}
+	for (int cy = floordiv(y1-1, CHUNK_H); cy <= floordiv(y2, CHUNK_H); cy++){
+		for (int cz = floordiv(z1-1, CHUNK_D); cz <= floordiv(z2, CHUNK_D); cz++){
+			for (int cx = floordiv(x1-1, CHUNK_W); cx <= floordiv(x2, CHUNK_W); cx++){
+				Chunk* chunk = chunks->getChunk(cx, cy, cz);
+				if (chunk)
+					chunks->markDirty(chunk, DIRTY_VOXELS);
+			}
+		}
+	}
+}
+
+void Chunks::fill(int x1, int y1, int z1, int x2, int y2, int z2, int id){
+	// whole chunks inside the region become uniform
+	editRegion(this, x1, y1, z1, x2, y2, z2, [=](Chunk* chunk, unsigned int index, int x, int y, int z){
+		if (index == 0 &&
+				x1 <= x && x + CHUNK_W <= x2 &&
+				y1 <= y && y + CHUNK_H <= y2 &&
+				z1 <= z && z + CHUNK_D <= z2){
+			chunk->voxels->fill(id);
+		}
+		if (!chunk->voxels->isUniform() || chunk->voxels->get(0).id != id)
+			chunk->voxels->set(index, id);
+	});
+}
+
+void Chunks::fillSphere(int x, int y, int z, int radius, int id){
+	const int cx = x, cy = y, cz = z;
+	editRegion(this, x-radius, y-radius, z-radius, x+radius+1, y+radius+1, z+radius+1,
+			[=](Chunk* chunk, unsigned int index, int x, int y, int z){
+		const int dx = x - cx, dy = y - cy, dz = z - cz;
+		if (dx*dx + dy*dy + dz*dz <= radius*radius)
+			chunk->voxels->set(index, id);
+	});
+}
+
+void Chunks::replace(int x1, int y1, int z1, int x2, int y2, int z2, int from, int to){
+	editRegion(this, x1, y1, z1, x2, y2, z2, [=](Chunk* chunk, unsigned int index, int, int, int){
+		if (chunk->voxels->get(index).id == from)
+			chunk->voxels->set(index, to);
+	});
+}
 
-	if (lx == 0 && (chunk = getChunk(cx-1, cy, cz))) chunk->modified = true;
-	if (ly == 0 && (chunk = getChunk(cx, cy-1, cz))) chunk->modified = true;
-	if (lz == 0 && (chunk = getChunk(cx, cy, cz-1))) chunk->modified = true;
+void Chunks::copy(int x1, int y1, int z1, int x2, int y2, int z2, voxel* dest){
+	const int w = x2 - x1;
+	const int d = z2 - z1;
+	for (int y = y1; y < y2; y++){
+		for (int z = z1; z < z2; z++){
+			for (int x = x1; x < x2; x++){
+				dest[((y - y1) * d + z - z1) * w + x - x1] = get(x, y, z);
+			}
+		}
+	}
+}
 
-	if (lx == CHUNK_W-1 && (chunk = getChunk(cx+1, cy, cz))) chunk->modified = true;
-	if (ly == CHUNK_H-1 && (chunk = getChunk(cx, cy+1, cz))) chunk->modified = true;
-	if (lz == CHUNK_D-1 && (chunk = getChunk(cx, cy, cz+1))) chunk->modified = true;
+void Chunks::paste(int x, int y, int z, int w, int h, int d, const voxel* source){
+	const int x1 = x, y1 = y, z1 = z;
+	editRegion(this, x, y, z, x+w, y+h, z+d, [=](Chunk* chunk, unsigned int index, int x, int y, int z){
+		chunk->voxels->set(index, source[((y - y1) * d + z - z1) * w + x - x1].id);
+	});
 }
 
-voxel* Chunks::rayCast(vec3 a, vec3 dir, float maxDist, vec3& end, vec3& norm, vec3& iend) {
-	float px = a.x;
-	float py = a.y;
-	float pz = a.z;
+bool Chunks::rayCast(vec3 a, vec3 dir, float maxDist, vec3& end, vec3& norm, vec3& iend) {
+	rayhit hit;
+	rayCast(ray {a, dir, maxDist}, hit);
+	end = hit.end;
+	norm = hit.norm;
+	iend = vec3(hit.iend);
+	return hit.hit;
+}
 
-	float dx = dir.x;
-	float dy = dir.y;
-	float dz = dir.z;
+// rays per worker job
+#define RAYS_BATCH 64
+
+void Chunks::rayCast(const ray* rays, rayhit* hits, size_t count, WorkerPool* workers){
+	if (workers == nullptr || count <= RAYS_BATCH){
+		for (size_t i = 0; i < count; i++)
+			rayCast(rays[i], hits[i]);
+		return;
+	}
+	workers->parallelFor((count + RAYS_BATCH - 1) / RAYS_BATCH, [=](size_t batch){
+		size_t end = std::min(count, (batch + 1) * RAYS_BATCH);
+		for (size_t i = batch * RAYS_BATCH; i < end; i++)
+			rayCast(rays[i], hits[i]);
+	});
+}
+
+// voxel boundaries of an axis crossed before t, at most limit
+static inline int crossings(float tMax, float tDelta, float t, int limit){
+	if (!(tMax < t))
+		return 0;
+	return std::min(limit, (int)ceil((t - tMax) / tDelta));
+}
+
+void Chunks::rayCast(const ray& ray, rayhit& hit) {
+	const float maxDist = ray.maxLength;
+	float px = ray.start.x;
+	float py = ray.start.y;
+	float pz = ray.start.z;
+
+	float dx = ray.dir.x;
+	float dy = ray.dir.y;
+	float dz = ray.dir.z;
 
 	float t = 0.0f;
 	int ix = floor(px);
@@ -141,22 +322,78 @@ voxel* Chunks::rayCast(vec3 a, vec3 dir, float maxDist, vec3& end, vec3& norm, v
 
 	int steppedIndex = -1;
 
+	// chunk holding the current voxel and its first voxel, looked up again
+	// only when the ray leaves it; voxels are tested with the solid mask
+	Chunk* chunk = nullptr;
+	bool empty = false;
+	int bx = ix + 1;
+	int by = iy;
+	int bz = iz;
+
 	while (t <= maxDist){
-		voxel* voxel = get(ix, iy, iz);
-		if (voxel == nullptr || voxel->id){
-			end.x = px + t * dx;
-			end.y = py + t * dy;
-			end.z = pz + t * dz;
-
-			iend.x = ix;
-			iend.y = iy;
-			iend.z = iz;
-
-			norm.x = norm.y = norm.z = 0.0f;
-			if (steppedIndex == 0) norm.x = -stepx;
-			if (steppedIndex == 1) norm.y = -stepy;
-			if (steppedIndex == 2) norm.z = -stepz;
-			return voxel;
+		unsigned int lx = ix - bx;
+		unsigned int ly = iy - by;
+		unsigned int lz = iz - bz;
+		if (lx >= CHUNK_W || ly >= CHUNK_H || lz >= CHUNK_D){
+			bx = floordiv(ix, CHUNK_W) * CHUNK_W;
+			by = floordiv(iy, CHUNK_H) * CHUNK_H;
+			bz = floordiv(iz, CHUNK_D) * CHUNK_D;
+			lx = ix - bx;
+			ly = iy - by;
+			lz = iz - bz;
+			chunk = getChunk(bx / CHUNK_W, by / CHUNK_H, bz / CHUNK_D);
+			if (chunk){
+				const VoxelPalette* voxels = chunk->voxels;
+				empty = voxels->isUniform() ? voxels->get(0).id == 0 : chunk->masks->isEmpty();
+			}
+		}
+		if (chunk == nullptr || ((chunk->masks->solid[ly * CHUNK_D + lz] >> lx) & 1)){
+			hit.end.x = px + t * dx;
+			hit.end.y = py + t * dy;
+			hit.end.z = pz + t * dz;
+
+			hit.iend.x = ix;
+			hit.iend.y = iy;
+			hit.iend.z = iz;
+
+			hit.norm.x = hit.norm.y = hit.norm.z = 0.0f;
+			if (steppedIndex == 0) hit.norm.x = -stepx;
+			if (steppedIndex == 1) hit.norm.y = -stepy;
+			if (steppedIndex == 2) hit.norm.z = -stepz;
+			hit.hit = chunk != nullptr;
+			hit.id = chunk ? chunk->voxels->get((ly * CHUNK_D + lz) * CHUNK_W + lx).id : 0;
+			hit.distance = t;
+			return;
+		}
+		// a chunk without solid voxels is crossed at once, to its exit face
+		if (empty){
+			const int sx = stepx > 0 ? bx + CHUNK_W - ix : ix - bx + 1;
+			const int sy = stepy > 0 ? by + CHUNK_H - iy : iy - by + 1;
+			const int sz = stepz > 0 ? bz + CHUNK_D - iz : iz - bz + 1;
+			const float txExit = (txDelta < infinity) ? txMax + (sx - 1) * txDelta : infinity;
+			const float tyExit = (tyDelta < infinity) ? tyMax + (sy - 1) * tyDelta : infinity;
+			const float tzExit = (tzDelta < infinity) ? tzMax + (sz - 1) * tzDelta : infinity;
+			int axis;
+			if (txExit < tyExit) {
+				axis = txExit < tzExit ? 0 : 2;
+			} else {
+				axis = tyExit < tzExit ? 1 : 2;
+			}
+			const float exit = axis == 0 ? txExit : (axis == 1 ? tyExit : tzExit);
+			if (exit <= maxDist){
+				const int nx = axis == 0 ? sx : crossings(txMax, txDelta, exit, sx - 1);
+				const int ny = axis == 1 ? sy : crossings(tyMax, tyDelta, exit, sy - 1);
+				const int nz = axis == 2 ? sz : crossings(tzMax, tzDelta, exit, sz - 1);
+				ix += nx * stepx;
+				iy += ny * stepy;
+				iz += nz * stepz;
+				if (nx) txMax += nx * txDelta;
+				if (ny) tyMax += ny * tyDelta;
+				if (nz) tzMax += nz * tzDelta;
+				t = exit;
+				steppedIndex = axis;
+				continue;
+			}
 		}
 		if (txMax < tyMax) {
 			if (txMax < tzMax) {
@@ -184,34 +421,55 @@ voxel* Chunks::rayCast(vec3 a, vec3 dir, float maxDist, vec3& end, vec3& norm, v
 			}
 		}
 	}
-	iend.x = ix;
-	iend.y = iy;
-	iend.z = iz;
+	hit.iend.x = ix;
+	hit.iend.y = iy;
+	hit.iend.z = iz;
 
-	end.x = px + t * dx;
-	end.y = py + t * dy;
-	end.z = pz + t * dz;
-	norm.x = norm.y = norm.z = 0.0f;
-	return nullptr;
+	hit.end.x = px + t * dx;
+	hit.end.y = py + t * dy;
+	hit.end.z = pz + t * dz;
+	hit.norm.x = hit.norm.y = hit.norm.z = 0.0f;
+	hit.hit = false;
+	hit.id = 0;
+	hit.distance = t;
 }
 
-void Chunks::write(unsigned char* dest) {
+size_t Chunks::write(unsigned char* dest) {
 	size_t index = 0;
-	for (size_t i = 0; i < volume; i++){
-		Chunk* chunk = chunks[i];
-		for (size_t j = 0; j < CHUNK_VOL; j++, index++){
-			dest[index] = chunk->voxels[j].id;
-		}
+	for (auto& entry : chunks){
+		Chunk* chunk = entry.second;
+		int32_t coords[3] = {chunk->x, chunk->y, chunk->z};
+		memcpy(dest + index, coords, sizeof(coords));
+		index += sizeof(coords);
+		chunk->voxels->write((voxel*)(dest + index));
+		index += CHUNK_VOL;
 	}
+	return index;
 }
 
-void Chunks::read(unsigned char* source) {
-	size_t index = 0;
-	for (size_t i = 0; i < volume; i++){
-		Chunk* chunk = chunks[i];
-		for (size_t j = 0; j < CHUNK_VOL; j++, index++){
-			chunk->voxels[j].id = source[index];
+void Chunks::read(const unsigned char* source, size_t size, std::vector<Chunk*>& changed) {
+	const size_t record = sizeof(int32_t) * 3 + CHUNK_VOL;
+	for (size_t index = 0; index + record <= size; index += record){
+		int32_t coords[3];
+		memcpy(coords, source + index, sizeof(coords));
+		Chunk* chunk = getChunk(coords[0], coords[1], coords[2]);
+		if (chunk == nullptr)
+			continue;
+		const voxel* voxels = (const voxel*)(source + index + sizeof(coords));
+		unsigned int i = 0;
+		while (i < CHUNK_VOL && chunk->voxels->get(i).id == voxels[i].id)
+			i++;
+		if (i == CHUNK_VOL)
+			continue;
+		changed.push_back(chunk);
+		chunk->voxels->read(voxels);
+		chunk->masks->build(chunk->voxels);
+		markDirty(chunk, DIRTY_VOXELS);
+		// border faces of the chunks next to it may have changed too
+		static const int faces[] = {4, 10, 12, 14, 16, 22};
+		for (int face : faces){
+			if (Chunk* other = chunk->neighbours[face])
+				markDirty(other, DIRTY_VOXELS);
 		}
-		chunk->modified = true;
 	}
 }
@@ -2,31 +2,92 @@
 #define VOXELS_CHUNKS_H_
 
 #include <stdlib.h>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
 #include <glm/glm.hpp>
+#include "voxel.h"
+#include "Chunk.h"
 
 using namespace glm;
 
-class Chunk;
-class voxel;
+class WorkerPool;
 
+struct ray {
+	vec3 start;
+	vec3 dir;
+	float maxLength;
+};
+
+struct rayhit {
+	// false if nothing was hit within maxLength or the ray reached an unloaded chunk
+	bool hit;
+	vec3 end;
+	vec3 norm;
+	// the hit voxel, id is its block
+	ivec3 iend;
+	uint8_t id;
+	float distance;
+};
+
+// Sparse set of loaded chunks, unbounded along x and z.
+// Vertically the world is h chunks tall.
 class Chunks {
 public:
-	Chunk** chunks;
-	size_t volume;
-	unsigned int w,h,d;
+	std::unordered_map<uint64_t, Chunk*> chunks;
+	// chunks to remesh, each listed once; see Chunk::dirty
+	std::vector<Chunk*> dirty;
+	// put chunks by Chunk::slot, nullptr in free slots; small ids for
+	// places that keep many references to chunks, such as light queues
+	std::vector<Chunk*> slots;
+	std::vector<uint32_t> freeSlots;
+	unsigned int h;
 
-	Chunks(int w, int h, int d);
+	Chunks(int h);
 	~Chunks();
 
+	static inline uint64_t key(int x, int y, int z){
+		return ((uint64_t)(x & 0x1FFFFF) << 42) | ((uint64_t)(z & 0x1FFFFF) << 21) | (uint64_t)(y & 0x1FFFFF);
+	}
+
+	inline void markDirty(Chunk* chunk, unsigned char reason){
+		if (chunk->dirty == 0)
+			dirty.push_back(chunk);
+		chunk->dirty |= reason;
+	}
+	void clearDirty();
+
+	void put(Chunk* chunk);
+	void remove(int x, int y, int z);
+
 	Chunk* getChunk(int x, int y, int z);
 	Chunk* getChunkByVoxel(int x, int y, int z);
-	voxel* get(int x, int y, int z);
+	voxel get(int x, int y, int z);
 	unsigned char getLight(int x, int y, int z, int channel);
 	void set(int x, int y, int z, int id);
-	voxel* rayCast(vec3 start, vec3 dir, float maxLength, vec3& end, vec3& norm, vec3& iend);
+	// one above the highest solid voxel of column x,z under y (see VoxelMasks::heights),
+	// 0 if there is none; getHeight(x, h * CHUNK_H, z) is the top of the column
+	int getHeight(int x, int y, int z);
+
+	// Region edits write the voxels of loaded chunks in [x1,x2) x [y1,y2) x [z1,z2)
+	// and mark the touched chunks dirty once; Lighting::onRegionSet relights them
+	void fill(int x1, int y1, int z1, int x2, int y2, int z2, int id);
+	void fillSphere(int x, int y, int z, int radius, int id);
+	void replace(int x1, int y1, int z1, int x2, int y2, int z2, int from, int to);
+	// dest and source hold the region voxels indexed by (y * d + z) * w + x,
+	// voxels of unloaded chunks are copied as air
+	void copy(int x1, int y1, int z1, int x2, int y2, int z2, voxel* dest);
+	void paste(int x, int y, int z, int w, int h, int d, const voxel* source);
+
+	bool rayCast(vec3 start, vec3 dir, float maxLength, vec3& end, vec3& norm, vec3& iend);
+	void rayCast(const ray& ray, rayhit& hit);
+	// casts count rays, split across the workers when they are given;
+	// chunks must not be modified until it returns
+	void rayCast(const ray* rays, rayhit* hits, size_t count, WorkerPool* workers);
 
-	void write(unsigned char* dest);
-	void read(unsigned char* source);
+	size_t write(unsigned char* dest);
+	// chunks whose voxels differ from the source are added to changed
+	void read(const unsigned char* source, size_t size, std::vector<Chunk*>& changed);
 };
 
 #endif /* VOXELS_CHUNKS_H_ */
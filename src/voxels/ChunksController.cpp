@@ -0,0 +1,93 @@
+#include "ChunksController.h"
+#include "Chunks.h"
+#include "Chunk.h"
+#include "WorldGenerator.h"
+#include "../jobs/WorkerPool.h"
+
+#include <math.h>
+#include <vector>
+
+ChunksController::ChunksController(Chunks* chunks, WorkerPool* workers, WorldGenerator* generator, int loadRadius, int unloadRadius)
+	: chunks(chunks), workers(workers), generator(generator), loadRadius(loadRadius), unloadRadius(unloadRadius){
+}
+
+// true for the bottom chunk of a column farther than radius from column cx,cz
+static inline bool isFar(const Chunk* chunk, int cx, int cz, int radius){
+	if (chunk->y != 0)
+		return false;
+	int dx = chunk->x - cx;
+	int dz = chunk->z - cz;
+	return dx*dx + dz*dz > radius*radius;
+}
+
+bool ChunksController::unloads(vec3 position, int margin) const {
+	const int cx = floor(position.x / CHUNK_W);
+	const int cz = floor(position.z / CHUNK_D);
+	for (auto& entry : chunks->chunks){
+		if (isFar(entry.second, cx, cz, unloadRadius + margin))
+			return true;
+	}
+	return false;
+}
+
+bool ChunksController::update(vec3 position){
+	const bool unloaded = unload(position);
+	return load(position) || unloaded;
+}
+
+bool ChunksController::unload(vec3 position){
+	const int cx = floor(position.x / CHUNK_W);
+	const int cz = floor(position.z / CHUNK_D);
+
+	std::vector<ivec3> columns;
+	for (auto& entry : chunks->chunks){
+		Chunk* chunk = entry.second;
+		if (isFar(chunk, cx, cz, unloadRadius))
+			columns.push_back(ivec3(chunk->x, 0, chunk->z));
+	}
+	for (ivec3& column : columns){
+		for (unsigned int y = 0; y < chunks->h; y++){
+			chunks->remove(column.x, y, column.z);
+		}
+	}
+	return !columns.empty();
+}
+
+bool ChunksController::load(vec3 position){
+	const int cx = floor(position.x / CHUNK_W);
+	const int cz = floor(position.z / CHUNK_D);
+	loaded.clear();
+
+	std::vector<ivec3> columns;
+	for (int dz = -loadRadius; dz <= loadRadius; dz++){
+		for (int dx = -loadRadius; dx <= loadRadius; dx++){
+			if (dx*dx + dz*dz > loadRadius*loadRadius)
+				continue;
+			if (chunks->getChunk(cx+dx, 0, cz+dz))
+				continue;
+			columns.push_back(ivec3(cx+dx, 0, cz+dz));
+		}
+	}
+	if (columns.empty())
+		return false;
+
+	// column fields first, then the chunks of each column on top of them
+	std::vector<ColumnData> fields(columns.size());
+	workers->parallelFor(columns.size(), [&](size_t i){
+		generator->generateColumn(&fields[i], columns[i].x, columns[i].z);
+	});
+
+	const size_t h = chunks->h;
+	std::vector<Chunk*> generated(columns.size() * h);
+	workers->parallelFor(generated.size(), [&](size_t i){
+		ColumnData& column = fields[i / h];
+		Chunk* chunk = new Chunk(column.x, i % h, column.z);
+		generator->generate(chunk, &column);
+		generated[i] = chunk;
+	});
+	for (Chunk* chunk : generated){
+		chunks->put(chunk);
+	}
+	loaded.swap(generated);
+	return true;
+}
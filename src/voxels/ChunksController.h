@@ -0,0 +1,40 @@
+#ifndef VOXELS_CHUNKSCONTROLLER_H_
+#define VOXELS_CHUNKSCONTROLLER_H_
+
+#include <vector>
+#include <glm/glm.hpp>
+
+using namespace glm;
+
+class Chunks;
+class Chunk;
+class WorkerPool;
+class WorldGenerator;
+
+// Keeps chunk columns loaded around a point: missing columns closer than
+// loadRadius are generated on the workers, columns farther than
+// unloadRadius are unloaded
+class ChunksController {
+	Chunks* chunks;
+	WorkerPool* workers;
+	WorldGenerator* generator;
+	int loadRadius;
+	int unloadRadius;
+public:
+	// chunks put by the last update, to be lit with Lighting::onChunksLoaded
+	std::vector<Chunk*> loaded;
+
+	ChunksController(Chunks* chunks, WorkerPool* workers, WorldGenerator* generator, int loadRadius, int unloadRadius);
+
+	// returns true if columns farther than unloadRadius + margin from position are
+	// loaded; light work still in flight has to be finished before unloading them
+	bool unloads(vec3 position, int margin) const;
+	// returns true if any chunk was unloaded
+	bool unload(vec3 position);
+	// returns true if any chunk was loaded
+	bool load(vec3 position);
+	// unload and load, returns true if any chunk was loaded or unloaded
+	bool update(vec3 position);
+};
+
+#endif /* VOXELS_CHUNKSCONTROLLER_H_ */
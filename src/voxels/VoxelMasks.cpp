@@ -0,0 +1,72 @@
+#include "VoxelMasks.h"
+#include "VoxelPalette.h"
+#include "Block.h"
+#include "voxel.h"
+#include "../memory/MemoryPool.h"
+
+static MemoryPool objects(sizeof(VoxelMasks), 256);
+
+void* VoxelMasks::operator new(size_t){
+	return objects.allocate();
+}
+
+void VoxelMasks::operator delete(void* ptr){
+	objects.release(ptr);
+}
+
+void VoxelMasks::build(const VoxelPalette* voxels){
+	if (voxels->isUniform()){
+		uint8_t id = voxels->get(0).id;
+		maskrow solidRow = id ? (maskrow)~0 : 0;
+		maskrow opaqueRow = Block::drawGroupTable[id] == 0 ? (maskrow)~0 : 0;
+		for (unsigned int i = 0; i < MASK_ROWS; i++){
+			solid[i] = solidRow;
+			opaque[i] = opaqueRow;
+		}
+		for (unsigned int i = 0; i < CHUNK_D * CHUNK_W; i++){
+			heights[i] = id ? CHUNK_H : 0;
+		}
+		return;
+	}
+	for (unsigned int i = 0; i < MASK_ROWS; i++){
+		maskrow solidRow = 0;
+		maskrow opaqueRow = 0;
+		for (unsigned int x = 0; x < CHUNK_W; x++){
+			uint8_t id = voxels->get(i * CHUNK_W + x).id;
+			solidRow |= (maskrow)((id != 0) << x);
+			opaqueRow |= (maskrow)((Block::drawGroupTable[id] == 0) << x);
+		}
+		solid[i] = solidRow;
+		opaque[i] = opaqueRow;
+	}
+	// top down, each column takes the first row where its bit is set
+	for (unsigned int z = 0; z < CHUNK_D; z++){
+		maskrow pending = (maskrow)~0;
+		for (unsigned int x = 0; x < CHUNK_W; x++){
+			heights[z * CHUNK_W + x] = 0;
+		}
+		for (int y = CHUNK_H-1; y >= 0 && pending; y--){
+			maskrow found = solid[y * CHUNK_D + z] & pending;
+			pending &= ~found;
+			for (; found; found &= found - 1){
+				heights[z * CHUNK_W + __builtin_ctz(found)] = y + 1;
+			}
+		}
+	}
+}
+
+void VoxelMasks::set(unsigned int index, uint8_t id){
+	const unsigned int row = index / CHUNK_W;
+	const maskrow bit = 1 << (index % CHUNK_W);
+	solid[row] = id ? (solid[row] | bit) : (solid[row] & ~bit);
+	opaque[row] = Block::drawGroupTable[id] == 0 ? (opaque[row] | bit) : (opaque[row] & ~bit);
+
+	const int x = index % CHUNK_W;
+	const int y = row / CHUNK_D;
+	const int z = row % CHUNK_D;
+	uint8_t& top = heights[z * CHUNK_W + x];
+	if (id && top <= y)
+		top = y + 1;
+	else if (!id && top == y + 1)
+		top = height(x, y, z);
+}
@@ -0,0 +1,56 @@
+#ifndef VOXELS_VOXELMASKS_H_
+#define VOXELS_VOXELMASKS_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "Chunk.h"
+
+// one row of a chunk, bit x is the voxel at x
+typedef uint16_t maskrow;
+#define MASK_ROWS (CHUNK_H * CHUNK_D)
+
+class VoxelPalette;
+
+// Block properties of every chunk voxel as bit rows indexed by y * CHUNK_D + z,
+// so neighbour tests can be done for a whole row at once
+class VoxelMasks final {
+public:
+	// not air
+	maskrow solid[MASK_ROWS];
+	// draw group 0: hides faces of draw group 0 neighbours
+	maskrow opaque[MASK_ROWS];
+	// one above the highest solid voxel of each column, indexed by z * CHUNK_W + x;
+	// 0 for columns of air
+	uint8_t heights[CHUNK_D * CHUNK_W];
+
+	// objects come from a pool of sizeof(VoxelMasks), the class is final for that
+	static void* operator new(size_t);
+	static void operator delete(void* ptr);
+
+	// rebuilds all rows from the voxels
+	void build(const VoxelPalette* voxels);
+	void set(unsigned int index, uint8_t id);
+
+	// no solid voxel in the chunk
+	inline bool isEmpty() const {
+		maskrow any = 0;
+		for (int i = 0; i < MASK_ROWS; i++)
+			any |= solid[i];
+		return any == 0;
+	}
+
+	// one above the highest solid voxel of column x,z under row y, 0 if there is none
+	inline int height(int x, int y, int z) const {
+		if (y >= CHUNK_H)
+			return heights[z * CHUNK_W + x];
+		for (; y > 0; y--){
+			if ((solid[(y-1) * CHUNK_D + z] >> x) & 1)
+				break;
+		}
+		return y;
+	}
+};
+
+static_assert(CHUNK_W == sizeof(maskrow) * 8, "mask rows must hold CHUNK_W bits");
+
+#endif /* VOXELS_VOXELMASKS_H_ */
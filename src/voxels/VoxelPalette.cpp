@@ -0,0 +1,135 @@
+#include "VoxelPalette.h"
+#include "Chunk.h"
+#include "../memory/MemoryPool.h"
+
+#include <string.h>
+
+// shared by all uniform palettes: every voxel reads entry 0
+static uint8_t uniformData[1] = {0};
+
+// index data is followed by the palette ids in the same block
+static MemoryPool pool1(CHUNK_VOL / 8 + 2, 64);
+static MemoryPool pool2(CHUNK_VOL / 4 + 4, 64);
+static MemoryPool pool4(CHUNK_VOL / 2 + 16, 32);
+static MemoryPool pool8(CHUNK_VOL + 256, 16);
+static MemoryPool objects(sizeof(VoxelPalette), 256);
+
+static MemoryPool* getPool(unsigned int bits){
+	switch (bits){
+		case 1: return &pool1;
+		case 2: return &pool2;
+		case 4: return &pool4;
+		default: return &pool8;
+	}
+}
+
+VoxelPalette::VoxelPalette() : data(uniformData), ids(&uniformId), size(1), bits(0), mask(0), uniformId(0) {
+}
+
+VoxelPalette::~VoxelPalette(){
+	release();
+}
+
+void* VoxelPalette::operator new(size_t){
+	return objects.allocate();
+}
+
+void VoxelPalette::operator delete(void* ptr){
+	objects.release(ptr);
+}
+
+void VoxelPalette::release(){
+	if (bits)
+		getPool(bits)->release(data);
+}
+
+void VoxelPalette::allocate(unsigned int bits){
+	release();
+	this->bits = bits;
+	mask = (1u << bits) - 1;
+
+	if (bits == 0){
+		data = uniformData;
+		ids = &uniformId;
+		return;
+	}
+	const size_t bytes = (CHUNK_VOL * bits) / 8;
+	data = (uint8_t*)getPool(bits)->allocate();
+	ids = data + bytes;
+	memset(data, 0, bytes);
+}
+
+unsigned int VoxelPalette::find(uint8_t id) const {
+	unsigned int entry = 0;
+	while (entry < size && ids[entry] != id)
+		entry++;
+	return entry;
+}
+
+void VoxelPalette::set(unsigned int index, uint8_t id){
+	unsigned int entry = find(id);
+	if (entry == size){
+		if (size > mask){
+			// palette is full (or uniform): repack dropping unused ids,
+			// widening if still needed
+			voxel buffer[CHUNK_VOL];
+			write(buffer);
+			buffer[index].id = id;
+			read(buffer);
+			return;
+		}
+		ids[size++] = id;
+	}
+	if (bits == 0)
+		return;
+	const unsigned int bit = index * bits;
+	uint8_t& byte = data[bit >> 3];
+	byte = (byte & ~(mask << (bit & 7))) | (entry << (bit & 7));
+}
+
+void VoxelPalette::fill(uint8_t id){
+	allocate(0);
+	ids[0] = id;
+	size = 1;
+}
+
+void VoxelPalette::read(const voxel* source){
+	bool used[256] = {};
+	for (unsigned int i = 0; i < CHUNK_VOL; i++){
+		used[source[i].id] = true;
+	}
+
+	uint8_t indices[256];
+	unsigned int count = 0;
+	for (unsigned int id = 0; id < 256; id++){
+		if (used[id])
+			indices[id] = count++;
+	}
+
+	unsigned int bits = 0;
+	if (count > 1){
+		bits = 1;
+		while ((1u << bits) < count)
+			bits <<= 1;
+	}
+	allocate(bits);
+
+	size = 0;
+	for (unsigned int id = 0; id < 256; id++){
+		if (used[id])
+			ids[size++] = id;
+	}
+
+	if (bits == 0)
+		return;
+	for (unsigned int i = 0; i < CHUNK_VOL; i++){
+		const unsigned int bit = i * bits;
+		data[bit >> 3] |= indices[source[i].id] << (bit & 7);
+	}
+}
+
+void VoxelPalette::write(voxel* dest) const {
+	for (unsigned int i = 0; i < CHUNK_VOL; i++){
+		dest[i] = get(i);
+	}
+}
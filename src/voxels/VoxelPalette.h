@@ -0,0 +1,45 @@
+#ifndef VOXELS_VOXELPALETTE_H_
+#define VOXELS_VOXELPALETTE_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "voxel.h"
+
+// Chunk voxels stored as indices into a small table of block ids.
+// Indices are bit-packed with 1, 2, 4 or 8 bits per voxel, widened when
+// a new id does not fit into the palette. Chunks made of a single id use
+// 0 bits and keep no index array until another id is written.
+class VoxelPalette final {
+	uint8_t* data;
+	uint8_t* ids;
+	unsigned int size;
+	unsigned int bits;
+	unsigned int mask;
+	uint8_t uniformId;
+
+	void allocate(unsigned int bits);
+	void release();
+	unsigned int find(uint8_t id) const;
+public:
+	VoxelPalette();
+	~VoxelPalette();
+
+	// objects come from a pool of sizeof(VoxelPalette), the class is final for that
+	static void* operator new(size_t);
+	static void operator delete(void* ptr);
+
+	inline voxel get(unsigned int index) const {
+		const unsigned int bit = index * bits;
+		return voxel {ids[(data[bit >> 3] >> (bit & 7)) & mask]};
+	}
+
+	void set(unsigned int index, uint8_t id);
+	void fill(uint8_t id);
+
+	void read(const voxel* source);
+	void write(voxel* dest) const;
+
+	bool isUniform() const {return bits == 0;}
+};
+
+#endif /* VOXELS_VOXELPALETTE_H_ */
@@ -0,0 +1,83 @@
+#include "WorldGenerator.h"
+#include "Chunk.h"
+#include "voxel.h"
+#include "VoxelPalette.h"
+#include "VoxelMasks.h"
+#include "../noise/perlin.h"
+
+#define BLOCK_AIR 0
+#define BLOCK_STONE 1
+#define BLOCK_GRASS 2
+
+// how far 3D noise can move the surface from the height field
+#define SURFACE_NOISE 12.0f
+// voxels at or below this height are always grass
+#define FLOOR_HEIGHT 2
+
+void WorldGenerator::generateColumn(ColumnData* column, int x, int z){
+	column->x = x;
+	column->z = z;
+
+	float large[CHUNK_D * CHUNK_W];
+	float small[CHUNK_D * CHUNK_W];
+	perlin_grid(large, x * CHUNK_W, z * CHUNK_D, 0, CHUNK_W, CHUNK_D, 1, 0.0026125f);
+	perlin_grid(small, x * CHUNK_W, z * CHUNK_D, 0, CHUNK_W, CHUNK_D, 1, 0.006125f);
+
+	column->minHeight = column->maxHeight = (large[0] + small[0] * 0.5f) * 60 + 30;
+	for (int i = 0; i < CHUNK_D * CHUNK_W; i++){
+		float height = (large[i] + small[i] * 0.5f) * 60 + 30;
+		column->heights[i] = height;
+		if (height < column->minHeight) column->minHeight = height;
+		if (height > column->maxHeight) column->maxHeight = height;
+	}
+}
+
+void WorldGenerator::generate(Chunk* chunk, const ColumnData* column){
+	const int y0 = chunk->y * CHUNK_H;
+	// one layer above the chunk is needed to find exposed surface voxels
+	const int y1 = y0 + CHUNK_H;
+
+	if (y0 > FLOOR_HEIGHT){
+		if (y0 >= column->maxHeight + SURFACE_NOISE){
+			chunk->voxels->fill(BLOCK_AIR);
+			chunk->masks->build(chunk->voxels);
+			return;
+		}
+		if (y1 < column->minHeight - SURFACE_NOISE){
+			chunk->voxels->fill(BLOCK_STONE);
+			chunk->masks->build(chunk->voxels);
+			return;
+		}
+	}
+
+	// density, solid where the noise-shifted surface is above the voxel
+	float noise[(CHUNK_H + 1) * CHUNK_D * CHUNK_W];
+	perlin_grid(noise, chunk->x * CHUNK_W, y0, chunk->z * CHUNK_D, CHUNK_W, CHUNK_H + 1, CHUNK_D, 0.0125f);
+
+	bool solid[(CHUNK_H + 1) * CHUNK_D * CHUNK_W];
+	for (int y = 0; y <= CHUNK_H; y++){
+		for (int i = 0; i < CHUNK_D * CHUNK_W; i++){
+			const int index = y * CHUNK_D * CHUNK_W + i;
+			float offset = noise[index];
+			if (offset < -1.0f) offset = -1.0f;
+			if (offset > 1.0f) offset = 1.0f;
+			solid[index] = column->heights[i] + offset * SURFACE_NOISE > y0 + y;
+		}
+	}
+
+	// decoration
+	voxel buffer[CHUNK_VOL];
+	for (int y = 0; y < CHUNK_H; y++){
+		for (int i = 0; i < CHUNK_D * CHUNK_W; i++){
+			const int index = y * CHUNK_D * CHUNK_W + i;
+			int id = BLOCK_AIR;
+			if (solid[index])
+				id = solid[index + CHUNK_D * CHUNK_W] ? BLOCK_STONE : BLOCK_GRASS;
+			if (y0 + y <= FLOOR_HEIGHT)
+				id = BLOCK_GRASS;
+			buffer[index].id = id;
+		}
+	}
+	chunk->voxels->read(buffer);
+	chunk->masks->build(chunk->voxels);
+}
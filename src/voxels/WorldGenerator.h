@@ -0,0 +1,26 @@
+#ifndef VOXELS_WORLDGENERATOR_H_
+#define VOXELS_WORLDGENERATOR_H_
+
+#include "Chunk.h"
+
+// 2D fields of a chunk column, computed once and shared by all chunks of the column
+struct ColumnData {
+	int x, z;
+	// terrain surface height, indexed by z * CHUNK_W + x
+	float heights[CHUNK_D * CHUNK_W];
+	float minHeight;
+	float maxHeight;
+};
+
+// Terrain generation in stages:
+// 1. column fields (heights) - generateColumn, once per column
+// 2. density: 3D noise moves the surface up and down by at most SURFACE_NOISE,
+//    chunks entirely above or below that band are filled without it
+// 3. decoration: grass on exposed surface voxels and the world floor
+class WorldGenerator {
+public:
+	void generateColumn(ColumnData* column, int x, int z);
+	void generate(Chunk* chunk, const ColumnData* column);
+};
+
+#endif /* VOXELS_WORLDGENERATOR_H_ */